@@ -34,6 +34,7 @@ void dmd_overlay (void)
 	dmd_pagepair_t dst = wpc_dmd_get_mapped ();
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, DMD_OVERLAY_PAGE);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dst.u.second);
 }
 
@@ -47,10 +48,12 @@ void dmd_overlay_color (void)
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.second);
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, DMD_OVERLAY_PAGE+1);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.first);
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, DMD_OVERLAY_PAGE);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dst.u.second);
 }
@@ -66,9 +69,11 @@ void dmd_overlay_onto_color (void)
 
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.second);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.first);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dst.u.second);
 }
@@ -74,6 +74,7 @@ void dmd_text_outline (void)
 void dmd_text_blur (void)
 {
 	dmd_shadow ();
+	dmd_dirty_all (dmd_high_page);
 	dmd_flip_low_high ();
 }
 
@@ -105,8 +106,10 @@ void dmd_overlay_outline (void)
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, DMD_OVERLAY_PAGE);
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.first);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, dst.u.second);
 	dmd_or_page ();
+	dmd_dirty_merge (dmd_low_page, dmd_high_page);
 
 	wpc_dmd_set_mapped (dst);
 }
@@ -286,13 +286,14 @@ void ll_score_strobe_valid (void)
 		that was erased earlier. */
 		if (ll_sweep_off)
 		{
-			memset (dmd_low_buffer + ll_dmd_sweep_addr, 0, ll_sweep_width);
+			memset (dmd_low_window + ll_dmd_sweep_addr, 0, ll_sweep_width);
 		}
 		else
 		{
 			pinio_dmd_window_set (PINIO_DMD_WINDOW_1, DMD_OVERLAY_PAGE);
-			memcpy (dmd_low_buffer + ll_dmd_sweep_addr,
-				dmd_high_buffer + ll_dmd_sweep_addr, ll_sweep_width);
+			memcpy (dmd_low_window + ll_dmd_sweep_addr,
+				dmd_high_window + ll_dmd_sweep_addr, ll_sweep_width);
+			dmd_dirty_mark (dmd_low_page, ll_dmd_sweep_addr / DMD_BYTE_WIDTH, 1);
 			pinio_dmd_window_set (PINIO_DMD_WINDOW_1,
 				pinio_dmd_window_get (PINIO_DMD_WINDOW_0) + 1);
 		}
@@ -551,6 +551,18 @@ task_t *task_find_gid (task_gid_t gid)
 }
 
 
+/**
+ * Return the group ID of a task, or zero if it is no longer running.
+ * This lets a saved task pointer be checked before it is used.
+ */
+task_gid_t task_pid_gid (task_t *tp)
+{
+	if (tp->state & BLOCK_TASK)
+		return tp->gid;
+	return 0;
+}
+
+
 /**
  * Kills the given task.
  * Killing yourself (suicide) is illegal, so don't do it.
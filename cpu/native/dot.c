@@ -24,20 +24,20 @@ void dmd_or_page (void)
 {
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
-		dmd_low_buffer[n] |= dmd_high_buffer[n];
+		dmd_low_window[n] |= dmd_high_window[n];
 }
 
 void dmd_and_page (void)
 {
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
-		dmd_low_buffer[n] &= dmd_high_buffer[n];
+		dmd_low_window[n] &= dmd_high_window[n];
 }
 
 void dmd_xor_page (void)
 {
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
-		dmd_low_buffer[n] ^= dmd_high_buffer[n];
+		dmd_low_window[n] ^= dmd_high_window[n];
 }
 
@@ -19,11 +19,19 @@
  */
 
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <freewpc.h>
 #include <native/log.h>
 #include <simulation.h>
 
+#ifdef CONFIG_SIM
+extern int linux_irq_multiplier;
+#else
+#define linux_irq_multiplier 1
+#endif
+
 bool linux_irq_enable;
 bool linux_firq_enable;
 extern void do_firq (void);
@@ -44,6 +52,20 @@ unsigned long realtime_read (void)
 	return realtime_counter;
 }
 
+#if defined(CONFIG_SCHED_PROFILE) || defined(CONFIG_CALLSET_PROFILE)
+/**
+ * Returns the host time in nanoseconds, for profiling the IRQ
+ * schedule and event handlers.  Unlike realtime_read(), this does
+ * advance while an IRQ or a handler is running.
+ */
+unsigned long realtime_profile_read (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+#endif
+
 /** Realtime callback function.
  *
  * This event simulates an elapsed 1ms.
@@ -94,6 +116,59 @@ void realtime_tick (void)
 }
 
 
+#ifdef CONFIG_UCONTEXT
+/**
+ * Implement the realtime loop for the single-threaded task scheduler.
+ *
+ * This runs as an ordinary task, once per pass through the task table.
+ * Each time it runs, exactly 1ms of simulated time elapses.  Task sleeps
+ * are measured against this clock and not against wall time, so the
+ * simulation is deterministic.  The wall clock is only consulted to keep
+ * the simulation from running faster than linux_irq_multiplier times
+ * realtime.  When the multiplier is zero (turbo mode), there is no pacing
+ * at all and the clock runs as fast as the host CPU allows.  This task
+ * must never block without yielding, since all other tasks share its
+ * OS thread.
+ */
+void realtime_loop (void)
+{
+	struct timeval start_time, curr_time;
+	unsigned long ticks = 0;
+	int multiplier = linux_irq_multiplier;
+	long long usecs_ahead;
+
+	gettimeofday (&start_time, NULL);
+	for (;;)
+	{
+		realtime_counter++;
+		realtime_tick ();
+		ticks++;
+
+		/* If the speed was changed, start pacing again from here, so that
+		the time already simulated at the old rate is not counted. */
+		if (linux_irq_multiplier != multiplier)
+		{
+			multiplier = linux_irq_multiplier;
+			gettimeofday (&start_time, NULL);
+			ticks = 0;
+		}
+
+		/* If the simulation has gotten ahead of the wall clock, wait
+		for the clock to catch up. */
+		if (multiplier > 0)
+		{
+			gettimeofday (&curr_time, NULL);
+			usecs_ahead = (long long)ticks * 1000 / multiplier
+				- (curr_time.tv_sec - start_time.tv_sec) * 1000000LL
+				- (curr_time.tv_usec - start_time.tv_usec);
+			if (usecs_ahead >= 1000)
+				usleep (usecs_ahead);
+		}
+
+		task_yield ();
+	}
+}
+#else
 /**
  * Implement a realtime loop on a non-realtime OS.
  *
@@ -181,6 +256,7 @@ void realtime_loop (void)
 		that we stay on schedule */
 	}
 }
+#endif /* CONFIG_UCONTEXT */
 
 
 CALLSET_ENTRY (native_realtime, init)
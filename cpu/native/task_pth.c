@@ -55,10 +55,63 @@ typedef struct
 	PTR_OR_U16 arg;
 	U8 duration;
 	unsigned char class_data[32];
+
+	/** The task's entry point */
+	task_function_t fn;
+
+	/** Links to the previous/next slots in the same gid bucket, or -1 */
+	int gid_prev, gid_next;
+
+	/** Link to the next slot in the same pid bucket, or -1 */
+	int pid_next;
 } aux_task_data_t;
 
 aux_task_data_t task_data_table[NUM_TASKS];
 
+typedef pth_t task_index_pid_t;
+#include <native/task_index.h>
+
+/** A pth thread-specific key that holds the task table slot of each
+ * thread.  All pth threads share one OS thread, so compiler TLS cannot
+ * be used here.  The value stored is the slot plus one, so that an
+ * unset key can be told apart from slot zero. */
+static pth_key_t task_slot_key;
+
+
+/** Return the task table slot of the calling thread, or -1. */
+static inline int task_self_slot (void)
+{
+	return (int)(long)pth_key_getspecific (task_slot_key) - 1;
+}
+
+
+static inline void task_set_self_slot (int slot)
+{
+	pth_key_setspecific (task_slot_key, (void *)(long)(slot + 1));
+}
+
+
+/** Return the task table slot for a pid, or -1 if it is not running.
+ * Lookups of the calling task are answered from the thread-specific
+ * key; other pids are found through the pid index. */
+static int task_slot_of (pth_t pid)
+{
+	if (pid == NULL)
+		return -1;
+	if (pid == pth_self ())
+		return task_self_slot ();
+	return task_index_find_pid (pid);
+}
+
+
+/** Free a task slot. */
+static void task_slot_free (int slot)
+{
+	task_index_remove (slot);
+	task_data_table[slot].pid = 0;
+	ui_write_task (slot, 0);
+}
+
 
 void task_dump (void)
 {
@@ -86,6 +139,21 @@ void idle_profile_rtt (void)
 }
 
 
+/**
+ * The entry point for every pth thread that runs a task.  It records the
+ * thread's task slot before calling the real task function, and exits
+ * the task cleanly if the function returns.
+ */
+static void *task_entry (void *arg)
+{
+	int slot = (int)(long)arg;
+
+	task_set_self_slot (slot);
+	task_data_table[slot].fn ();
+	task_exit ();
+}
+
+
 /**
  * The main function for creating a new task.
  */
@@ -99,6 +167,12 @@ task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 	printf ("task_create_gid: gid=%d, fn=%p\n", gid, fn);
 #endif
 
+	for (i=0; i < NUM_TASKS; i++)
+		if (task_data_table[i].pid == 0)
+			break;
+	if (i == NUM_TASKS)
+		fatal (ERR_NO_FREE_TASKS);
+
 	/* Set the task attributes:
 	 * - Not joinable : all tasks are independent
 	 * - cancellable : task kill is permitted
@@ -113,35 +187,30 @@ task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 	else if (gid == GID_LINUX_INTERFACE) /* user input */
 		pth_attr_set (attr, PTH_ATTR_PRIO, PTH_PRIO_STD + 1);
 
-	/* TODO - inside of calling the function directly, call a global
-	 * function and pass it a pointer to the task_data_table entry
-	 * as an argument. */
-	pid = pth_spawn (attr, fn, 0);
-
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == 0)
-		{
-			task_data_table[i].pid = pid;
-			task_data_table[i].gid = gid;
-			task_data_table[i].duration = TASK_DURATION_INF;
-			task_data_table[i].arg.u16 = 0;
-			task_data_table[i].duration = TASK_DURATION_BALL;
-			ui_write_task (i, gid);
-			return (pid);
-		}
-
-	fatal (ERR_NO_FREE_TASKS);
+	/* pth does not switch threads until the caller yields, so the
+	 * table entry is complete before the new task begins running. */
+	task_data_table[i].fn = fn;
+	pid = pth_spawn (attr, task_entry, (void *)(long)i);
+	pth_attr_destroy (attr);
+
+	task_data_table[i].pid = pid;
+	task_data_table[i].gid = gid;
+	task_data_table[i].arg.u16 = 0;
+	task_data_table[i].duration = TASK_DURATION_BALL;
+	task_index_insert (i);
+	ui_write_task (i, gid);
+	return (pid);
 }
 
 void task_setgid (task_gid_t gid)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].gid = gid;
-			break;
-		}
+	int slot = task_self_slot ();
+
+	if (slot == -1)
+		return;
+	task_index_unlink_gid (slot);
+	task_data_table[slot].gid = gid;
+	task_index_link_gid (slot);
 }
 
 void task_sleep (task_ticks_t ticks)
@@ -162,29 +231,25 @@ void task_sleep_sec1 (U8 secs)
 __noreturn__ 
 void task_exit (void)
 {
-	int i;
+	int slot = task_self_slot ();
 #ifdef PTHDEBUG
 	printf ("task_exit: pid=%p\n", task_getpid ());
 #endif
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].pid = 0;
-			ui_write_task (i, 0);
-			for (;;)
-				pth_exit (0);
-		}
-	fatal (ERR_TASK_KILL_FAILED);
+	if (slot == -1 || task_data_table[slot].pid != pth_self ())
+		fatal (ERR_TASK_KILL_FAILED);
+	task_slot_free (slot);
+	for (;;)
+		pth_exit (0);
 }
 
 task_pid_t task_find_gid (task_gid_t gid)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
+	int slot;
+	for (slot = task_gid_head[task_gid_bucket (gid)];
+		slot != -1; slot = task_data_table[slot].gid_next)
 	{
-		if ((task_data_table[i].gid == gid)
-			&& (task_data_table[i].pid != 0))
-			return task_data_table[i].pid;
+		if (task_data_table[slot].gid == gid)
+			return task_data_table[slot].pid;
 	}
 	return NULL;
 }
@@ -192,53 +257,58 @@ task_pid_t task_find_gid (task_gid_t gid)
 
 task_pid_t task_find_gid_next (task_pid_t last, task_gid_t gid)
 {
-	int i;
-	int ok_to_return = 0;
-	for (i=0; i < NUM_TASKS; i++)
+	int slot = task_slot_of (last);
+
+	if (slot == -1)
+		return NULL;
+	for (slot = task_data_table[slot].gid_next;
+		slot != -1; slot = task_data_table[slot].gid_next)
 	{
-		if ((task_data_table[i].gid == gid) && (task_data_table[i].pid != 0))
-		{
-			if (ok_to_return)
-				return task_data_table[i].pid;
-			else if (task_data_table[i].pid == last)
-				ok_to_return = 1;
-		}
+		if (task_data_table[slot].gid == gid)
+			return task_data_table[slot].pid;
 	}
 	return NULL;
 }
 
 
+task_gid_t task_pid_gid (task_pid_t tp)
+{
+	int slot = task_slot_of (tp);
+
+	if (slot == -1)
+		return 0;
+	return task_data_table[slot].gid;
+}
+
+
 void task_kill_pid (task_pid_t tp)
 {
-	int i;
+	int slot;
 
 #ifdef PTHDEBUG
 	printf ("task_kill_pid: pid=%p\n", tp);
 #endif
 
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].pid = 0;
-			ui_write_task (i, 0);
-			if (tp != 0)
-				pth_abort (tp);
-			return;
-		}
+	slot = task_slot_of (tp);
+	if (slot != -1)
+	{
+		task_slot_free (slot);
+		pth_abort (tp);
+	}
 }
 
 bool task_kill_gid (task_gid_t gid)
 {
-	int i;
+	int slot, next;
 	bool rc = FALSE;
+	int self = task_self_slot ();
 
-	for (i=0; i < NUM_TASKS; i++)
+	for (slot = task_gid_head[task_gid_bucket (gid)]; slot != -1; slot = next)
 	{
-		if ((task_data_table[i].gid == gid) &&
-			 (task_data_table[i].pid != 0) &&
-			 (task_data_table[i].pid != task_getpid ()))
+		next = task_data_table[slot].gid_next;
+		if ((task_data_table[slot].gid == gid) && (slot != self))
 		{
-			task_kill_pid (task_data_table[i].pid);
+			task_kill_pid (task_data_table[slot].pid);
 			rc = TRUE;
 		}
 	}
@@ -260,93 +330,59 @@ void task_duration_expire (U8 cond)
 
 void task_set_duration (task_pid_t tp, U8 cond)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].duration = cond;
-			break;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].duration = cond;
 }
 
 
 void task_add_duration (U8 flags)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].duration |= flags;
-			break;
-		}
-	}
+	int slot = task_self_slot ();
+	if (slot != -1)
+		task_data_table[slot].duration |= flags;
 }
 
 
 void task_remove_duration (U8 flags)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].duration &= ~flags;
-			break;
-		}
-	}
+	int slot = task_self_slot ();
+	if (slot != -1)
+		task_data_table[slot].duration &= ~flags;
 }
 
 
 U16 task_get_arg (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].arg.u16;
-	}
-	fatal (ERR_CANT_GET_HERE);
+	int slot = task_self_slot ();
+	if (slot == -1)
+		fatal (ERR_CANT_GET_HERE);
+	return task_data_table[slot].arg.u16;
 }
 
 
 void *task_get_pointer_arg (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].arg.ptr;
-	}
-	fatal (ERR_CANT_GET_HERE);
+	int slot = task_self_slot ();
+	if (slot == -1)
+		fatal (ERR_CANT_GET_HERE);
+	return task_data_table[slot].arg.ptr;
 }
 
 
 void task_set_arg (task_pid_t tp, U16 arg)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].arg.u16 = arg;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].arg.u16 = arg;
 }
 
 
 void task_set_pointer_arg (task_pid_t tp, void *arg)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].arg.ptr = arg;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].arg.ptr = arg;
 }
 
 
@@ -358,25 +394,23 @@ task_pid_t task_getpid (void)
 
 task_gid_t task_getgid (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].gid;
-	}
-	return 255;
+	int slot = task_self_slot ();
+	if (slot == -1)
+		return 255;
+	return task_data_table[slot].gid;
 }
 
 
 void *task_get_class_data (task_pid_t pid)
 {
-	int i;
+	int slot = task_slot_of (pid);
 
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == pid)
-			return task_data_table[i].class_data;
-	printf ("task_get_class_data for pid %p failed\n", pid);
-	fatal (0xFD);
+	if (slot == -1)
+	{
+		printf ("task_get_class_data for pid %p failed\n", pid);
+		fatal (0xFD);
+	}
+	return task_data_table[slot].class_data;
 }
 
 void task_set_class_data (task_pid_t pid, size_t size)
@@ -387,11 +421,15 @@ void task_set_class_data (task_pid_t pid, size_t size)
 void task_init (void)
 {
 	memset (task_data_table, 0, sizeof (task_data_table));
+	task_index_init ();
 	
 	pth_init ();
+	pth_key_create (&task_slot_key, NULL);
 
 	task_data_table[0].pid = task_getpid ();
 	task_data_table[0].gid = GID_FIRST_TASK;
 	task_data_table[0].duration = TASK_DURATION_INF;
+	task_index_insert (0);
+	task_set_self_slot (0);
 }
 
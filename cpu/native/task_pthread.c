@@ -19,6 +19,7 @@
  */
 
 #include <unistd.h>
+#include <setjmp.h>
 #include <freewpc.h>
 #include <native/log.h>
 
@@ -29,10 +30,6 @@
  * It exposes the same task_ API functions, with similar semantics.
  */
 
-/* TODO:
-   - Create tasks in advance to minimize repeated overhead of spawning.
-*/
-
 /** Enable this to turn on verbose debugging of the task subsystem. */
 //#define PTHREAD_DEBUG
 
@@ -70,18 +67,108 @@ typedef struct
 	PTR_OR_U16 arg;
 	U8 duration;
 	unsigned char class_data[32];
+
+	/** Links to the previous/next slots in the same gid bucket, or -1 */
+	int gid_prev, gid_next;
+
+	/** Link to the next slot in the same pid bucket, or -1 */
+	int pid_next;
 } aux_task_data_t;
 
 aux_task_data_t task_data_table[NUM_TASKS];
 
+typedef pthread_t task_index_pid_t;
+#include <native/task_index.h>
+
+/** The task table slot used by the calling thread, or -1 if it is not
+ * running a task.  This makes lookups of the current task O(1). */
+static __thread int task_self_slot = -1;
+
 pthread_attr_t attr_default;
 pthread_attr_t attr_task;
 pthread_attr_t attr_input;
 pthread_attr_t attr_interrupt;
 
 
+/** The number of worker threads that are spawned during task_init(),
+ * before any task has been created. */
+#define TASK_POOL_PRESPAWN 8
+
+/** The maximum number of idle workers kept in the pool.  Workers that
+ * finish when the pool is already this large exit instead of parking. */
+#define TASK_POOL_MAX NUM_TASKS
+
+/* A worker is an OS thread that runs FreeWPC tasks.  When a task exits,
+ * its worker is parked on the idle list rather than being destroyed, and
+ * the next task_create_gid() hands it a new task function.  This avoids
+ * the overhead of spawning a thread for every short-lived task. */
+typedef struct task_worker
+{
+	/** The thread that implements this worker */
+	pthread_t pid;
+
+	/** Signalled when a new task function has been assigned */
+	pthread_cond_t wakeup;
+
+	/** The task function to run next, or NULL if idle */
+	task_function_t fn;
+
+	/** True if the worker can be returned to the pool after its task
+	 * finishes.  Workers created with special scheduling attributes
+	 * are not pooled. */
+	bool poolable;
+
+	/** The task table slot assigned to the task function */
+	int slot;
+
+	/** Where task_exit() returns to, to unwind the task's stack */
+	jmp_buf exit_jmp;
+
+	/** Link to the next idle worker */
+	struct task_worker *next;
+} task_worker_t;
+
+/** Protects the idle worker list and task table updates made
+ * during task creation and exit */
+static pthread_mutex_t task_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** The list of parked workers */
+static task_worker_t *task_pool_idle;
+
+/** The number of parked workers */
+static unsigned int task_pool_idle_count;
+
+/** The worker for the calling thread, or NULL for threads that were not
+ * created by the pool, such as the initial task. */
+static __thread task_worker_t *task_self_worker;
+
+/** The number of task creations satisfied by a parked worker */
+unsigned long task_pool_hits;
+
+/** The number of task creations that had to spawn a new thread */
+unsigned long task_pool_misses;
+
+
 void task_dump (void)
 {
+#ifdef DEBUGGER
+	int i;
+	dbprintf ("PID         GID   ARG    FLAGS\n");
+	for (i=0; i < NUM_TASKS; i++)
+	{
+		aux_task_data_t *td = &task_data_table[i];
+
+		if (td->pid != 0)
+		{
+			dbprintf ("%08lX%c   %d    %08X   %02X\n",
+				(unsigned long)td->pid,
+				(td->pid == task_getpid ()) ? '*' : ' ',
+				td->gid, td->arg.u16, td->duration);
+		}
+	}
+	dbprintf ("Pool: %u idle, %lu hits, %lu misses\n",
+		task_pool_idle_count, task_pool_hits, task_pool_misses);
+#endif
 }
 
 
@@ -90,16 +177,189 @@ void idle_profile_rtt (void)
 }
 
 
+/** Return the task table slot for a pid, or -1 if it is not running.
+ * Lookups of the calling task are answered from thread-local storage;
+ * other pids are found through the pid index. */
+static int task_slot_of (pthread_t pid)
+{
+	if (pid == 0)
+		return -1;
+	if (task_self_slot != -1 && pid == pthread_self ())
+		return task_self_slot;
+	return task_index_find_pid (pid);
+}
+
+
+/**
+ * Take task_pool_lock from task context.  Cancellation is held off until
+ * task_pool_unlock_task(), because ui_write_task() and the debug output can
+ * reach a cancellation point, and a task cancelled there would never
+ * release the lock.  Returns the previous cancel state.
+ */
+static int task_pool_lock_task (void)
+{
+	int old;
+
+	pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &old);
+	pthread_mutex_lock (&task_pool_lock);
+	return old;
+}
+
+
+/** Release task_pool_lock and restore the cancel state returned by
+ * task_pool_lock_task(). */
+static void task_pool_unlock_task (int old)
+{
+	pthread_mutex_unlock (&task_pool_lock);
+	pthread_setcancelstate (old, NULL);
+}
+
+
+/** Free a task slot.  The caller must hold task_pool_lock. */
+static void task_slot_free (int slot)
+{
+	task_index_remove (slot);
+	task_data_table[slot].pid = 0;
+#ifdef CONFIG_SIM
+	ui_write_task (slot, 0);
+#endif
+}
+
+
+/**
+ * Release the task table entry for the calling thread.
+ * Returns FALSE if the caller did not own an entry.
+ */
+static bool task_release_self (void)
+{
+	int slot = task_self_slot;
+
+	if (slot == -1 || task_data_table[slot].pid != pthread_self ())
+		return FALSE;
+	task_slot_free (slot);
+	task_self_slot = -1;
+	pthread_debug ("task_release_self: index=%d\n", slot);
+	return TRUE;
+}
+
+
+/**
+ * Called when a worker is cancelled by task_kill_pid().  The thread is
+ * going away, so its worker cannot be pooled.  Cancellation is only
+ * enabled while a task function runs, so the worker is never on the
+ * idle list here, and task_pool_lock is not held by it.
+ */
+static void task_worker_cleanup (void *_w)
+{
+	task_worker_t *w = _w;
+	pthread_cond_destroy (&w->wakeup);
+	free (w);
+}
+
+
+/**
+ * The entry point for every worker thread.
+ *
+ * A worker waits until it is assigned a task function, runs it, and then
+ * parks itself on the idle list to wait for the next one.  A task finishes
+ * either by returning from its function or by calling task_exit(), which
+ * longjmps back here.
+ *
+ * The worker can only be cancelled while the task function is running.
+ * A task_kill_pid() that races with the end of the task leaves the
+ * cancel pending; it is acted on before the worker parks again, so that
+ * it never reaches the next task.
+ */
+static void *task_worker_main (void *_w)
+{
+	task_worker_t *w = _w;
+	task_function_t fn;
+
+	task_self_worker = w;
+	pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_cleanup_push (task_worker_cleanup, w);
+	for (;;)
+	{
+		pthread_mutex_lock (&task_pool_lock);
+		if (w->fn == NULL)
+		{
+			if (!w->poolable || task_pool_idle_count >= TASK_POOL_MAX)
+			{
+				pthread_mutex_unlock (&task_pool_lock);
+				break;
+			}
+			w->next = task_pool_idle;
+			task_pool_idle = w;
+			task_pool_idle_count++;
+			while (w->fn == NULL)
+				pthread_cond_wait (&w->wakeup, &task_pool_lock);
+		}
+		fn = w->fn;
+		w->fn = NULL;
+		task_self_slot = w->slot;
+		pthread_mutex_unlock (&task_pool_lock);
+
+		if (setjmp (w->exit_jmp) == 0)
+		{
+			pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+			fn ();
+			pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+
+			/* The task returned without calling task_exit() */
+			pthread_mutex_lock (&task_pool_lock);
+			task_release_self ();
+			pthread_mutex_unlock (&task_pool_lock);
+		}
+
+		pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+		pthread_testcancel ();
+		pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+	}
+	pthread_cleanup_pop (1);
+	return NULL;
+}
+
+
+/**
+ * Spawn a new worker thread.  If FN is NULL, the worker parks itself
+ * in the pool immediately.  Must be called with task_pool_lock held
+ * when FN is non-NULL, so that the task table is updated before the
+ * task begins running.
+ */
+static task_worker_t *task_worker_spawn (pthread_attr_t *attr,
+	task_function_t fn, int slot)
+{
+	task_worker_t *w;
+	int rc;
+
+	w = malloc (sizeof (task_worker_t));
+	if (w == NULL)
+		fatal (ERR_NO_FREE_TASKS);
+	pthread_cond_init (&w->wakeup, NULL);
+	w->fn = fn;
+	w->slot = slot;
+	w->poolable = (attr == &attr_task);
+	w->next = NULL;
+
+	rc = pthread_create (&w->pid, attr, task_worker_main, w);
+	if (rc != 0)
+	{
+		pthread_debug ("pthread_create failed, errno=%u\n", errno);
+		fatal (ERR_NO_FREE_TASKS);
+	}
+	return w;
+}
+
+
 /**
  * The main function for creating a new task.
  */
 task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 {
-	pthread_t pid;
+	task_worker_t *w;
 	pthread_attr_t *attr;
-	struct sched_param param;
+	int cancel_state;
 	int i;
-	int rc;
 
 	pthread_debug ("task_create_gid: gid=%d, fn=%p\n", gid, fn);
 
@@ -110,44 +370,61 @@ task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 	else
 		attr = &attr_task;
 
-	/* TODO - inside of calling the function directly, call a global
-	 * function and pass it a pointer to the task_data_table entry
-	 * as an argument. */
-	rc = pthread_create (&pid, attr, fn, 0);
-	if (rc != 0)
-	{
-		pthread_debug ("pthread_create failed, errno=%u\n", errno);
-		fatal (ERR_NO_FREE_TASKS);
-	}
+	cancel_state = task_pool_lock_task ();
 
 	for (i=0; i < NUM_TASKS; i++)
 		if (task_data_table[i].pid == 0)
-		{
-			task_data_table[i].pid = pid;
-			task_data_table[i].gid = gid;
-			task_data_table[i].duration = TASK_DURATION_INF;
-			task_data_table[i].arg.u16 = 0;
-			task_data_table[i].duration = TASK_DURATION_BALL;
+			break;
+	if (i == NUM_TASKS)
+		fatal (ERR_NO_FREE_TASKS);
+
+	/* Take a parked worker if one is available; otherwise, spawn
+	 * a new thread.  Tasks with special scheduling attributes always
+	 * get a thread of their own. */
+	if (attr == &attr_task && task_pool_idle != NULL)
+	{
+		w = task_pool_idle;
+		task_pool_idle = w->next;
+		task_pool_idle_count--;
+		w->slot = i;
+		w->fn = fn;
+		pthread_cond_signal (&w->wakeup);
+		task_pool_hits++;
+	}
+	else
+	{
+		w = task_worker_spawn (attr, fn, i);
+		if (attr == &attr_task)
+			task_pool_misses++;
+	}
+
+	task_data_table[i].pid = w->pid;
+	task_data_table[i].gid = gid;
+	task_data_table[i].arg.u16 = 0;
+	task_data_table[i].duration = TASK_DURATION_BALL;
+	task_index_insert (i);
 #ifdef CONFIG_SIM
-			ui_write_task (i, gid);
+	ui_write_task (i, gid);
 #endif
-			pthread_debug ("pthread_create: index=%d, pid=%u\n", i, (unsigned)pid);
-			return (pid);
-		}
+	pthread_debug ("task_create_gid: index=%d, pid=%u\n", i, (unsigned)w->pid);
 
-	fatal (ERR_NO_FREE_TASKS);
+	task_pool_unlock_task (cancel_state);
+	return (w->pid);
 }
 
 
 void task_setgid (task_gid_t gid)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].gid = gid;
-			break;
-		}
+	int slot = task_self_slot;
+	int cancel_state;
+
+	if (slot == -1)
+		return;
+	cancel_state = task_pool_lock_task ();
+	task_index_unlink_gid (slot);
+	task_data_table[slot].gid = gid;
+	task_index_link_gid (slot);
+	task_pool_unlock_task (cancel_state);
 }
 
 void task_sleep (task_ticks_t ticks)
@@ -164,31 +441,32 @@ void task_sleep_sec1 (U8 secs)
 __noreturn__
 void task_exit (void)
 {
-	int i;
+	bool found;
 
 	pthread_debug ("task_exit: pid=%u\n", (unsigned)task_getpid ());
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].pid = 0;
-#ifdef CONFIG_SIM
-			ui_write_task (i, 0);
-#endif
-			pthread_debug ("pthread_exit: index=%d\n", i);
-			for (;;)
-				pthread_exit (0);
-		}
-	fatal (ERR_TASK_KILL_FAILED);
+	pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_mutex_lock (&task_pool_lock);
+	found = task_release_self ();
+	pthread_mutex_unlock (&task_pool_lock);
+	if (!found)
+		fatal (ERR_TASK_KILL_FAILED);
+
+	/* Pooled workers unwind back to their main loop and wait for
+	another task; anything else exits for real. */
+	if (task_self_worker)
+		longjmp (task_self_worker->exit_jmp, 1);
+	for (;;)
+		pthread_exit (0);
 }
 
 task_pid_t task_find_gid (task_gid_t gid)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
+	int slot;
+	for (slot = task_gid_head[task_gid_bucket (gid)];
+		slot != -1; slot = task_data_table[slot].gid_next)
 	{
-		if ((task_data_table[i].gid == gid)
-			&& (task_data_table[i].pid != 0))
-			return task_data_table[i].pid;
+		if (task_data_table[slot].gid == gid)
+			return task_data_table[slot].pid;
 	}
 	return 0;
 }
@@ -196,56 +474,73 @@ task_pid_t task_find_gid (task_gid_t gid)
 
 task_pid_t task_find_gid_next (task_pid_t last, task_gid_t gid)
 {
-	int i;
-	int ok_to_return = 0;
-	for (i=0; i < NUM_TASKS; i++)
+	int slot = task_slot_of (last);
+
+	if (slot == -1)
+		return 0;
+	for (slot = task_data_table[slot].gid_next;
+		slot != -1; slot = task_data_table[slot].gid_next)
 	{
-		if ((task_data_table[i].gid == gid) && (task_data_table[i].pid != 0))
-		{
-			if (ok_to_return)
-				return task_data_table[i].pid;
-			else if (task_data_table[i].pid == last)
-				ok_to_return = 1;
-		}
+		if (task_data_table[slot].gid == gid)
+			return task_data_table[slot].pid;
 	}
 	return 0;
 }
 
 
+/** Kill the task in a slot.  The caller must hold task_pool_lock. */
+static void task_kill_slot (int slot)
+{
+	pthread_t tp = task_data_table[slot].pid;
+
+	task_slot_free (slot);
+	if (slot == task_self_slot)
+		task_self_slot = -1;
+	pthread_cancel (tp);
+}
+
+
+task_gid_t task_pid_gid (task_pid_t tp)
+{
+	int slot = task_slot_of (tp);
+
+	if (slot == -1)
+		return 0;
+	return task_data_table[slot].gid;
+}
+
+
 void task_kill_pid (task_pid_t tp)
 {
-	int i;
+	int slot;
+	int cancel_state;
 
 	pthread_debug ("task_kill_pid: pid=%u\n", (unsigned)tp);
 
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == tp)
-		{
-			if (tp != 0)
-				pthread_cancel (tp);
-			task_data_table[i].pid = 0;
-#ifdef CONFIG_SIM
-			ui_write_task (i, 0);
-#endif
-			return;
-		}
+	cancel_state = task_pool_lock_task ();
+	slot = task_slot_of (tp);
+	if (slot != -1)
+		task_kill_slot (slot);
+	task_pool_unlock_task (cancel_state);
 }
 
 bool task_kill_gid (task_gid_t gid)
 {
-	int i;
+	int slot, next;
+	int cancel_state;
 	bool rc = FALSE;
 
-	for (i=0; i < NUM_TASKS; i++)
+	cancel_state = task_pool_lock_task ();
+	for (slot = task_gid_head[task_gid_bucket (gid)]; slot != -1; slot = next)
 	{
-		if ((task_data_table[i].gid == gid) &&
-			 (task_data_table[i].pid != 0) &&
-			 (task_data_table[i].pid != task_getpid ()))
+		next = task_data_table[slot].gid_next;
+		if ((task_data_table[slot].gid == gid) && (slot != task_self_slot))
 		{
-			task_kill_pid (task_data_table[i].pid);
+			task_kill_slot (slot);
 			rc = TRUE;
 		}
 	}
+	task_pool_unlock_task (cancel_state);
 	return (rc);
 }
 
@@ -253,104 +548,69 @@ bool task_kill_gid (task_gid_t gid)
 void task_duration_expire (U8 cond)
 {
 	int i;
+	int cancel_state;
 
+	cancel_state = task_pool_lock_task ();
 	for (i=0; i < NUM_TASKS; i++)
 	{
 		if ((task_data_table[i].pid != 0) &&
 			 (task_data_table[i].duration & cond))
-			task_kill_pid (task_data_table[i].pid);
+			task_kill_slot (i);
 	}
+	task_pool_unlock_task (cancel_state);
 }
 
 void task_set_duration (task_pid_t tp, U8 cond)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].duration = cond;
-			break;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].duration = cond;
 }
 
 
 void task_add_duration (U8 flags)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].duration |= flags;
-			break;
-		}
-	}
+	if (task_self_slot != -1)
+		task_data_table[task_self_slot].duration |= flags;
 }
 
 
 void task_remove_duration (U8 flags)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-		{
-			task_data_table[i].duration &= ~flags;
-			break;
-		}
-	}
+	if (task_self_slot != -1)
+		task_data_table[task_self_slot].duration &= ~flags;
 }
 
 
 U16 task_get_arg (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].arg.u16;
-	}
-	fatal (ERR_CANT_GET_HERE);
+	if (task_self_slot == -1)
+		fatal (ERR_CANT_GET_HERE);
+	return task_data_table[task_self_slot].arg.u16;
 }
 
 
 void *task_get_pointer_arg (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].arg.ptr;
-	}
-	fatal (ERR_CANT_GET_HERE);
+	if (task_self_slot == -1)
+		fatal (ERR_CANT_GET_HERE);
+	return task_data_table[task_self_slot].arg.ptr;
 }
 
 
 void task_set_arg (task_pid_t tp, U16 arg)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].arg.u16 = arg;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].arg.u16 = arg;
 }
 
 
 void task_set_pointer_arg (task_pid_t tp, void *arg)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == tp)
-		{
-			task_data_table[i].arg.ptr = arg;
-		}
-	}
+	int slot = task_slot_of (tp);
+	if (slot != -1)
+		task_data_table[slot].arg.ptr = arg;
 }
 
 
@@ -362,25 +622,22 @@ task_pid_t task_getpid (void)
 
 task_gid_t task_getgid (void)
 {
-	int i;
-	for (i=0; i < NUM_TASKS; i++)
-	{
-		if (task_data_table[i].pid == task_getpid ())
-			return task_data_table[i].gid;
-	}
-	return 255;
+	if (task_self_slot == -1)
+		return 255;
+	return task_data_table[task_self_slot].gid;
 }
 
 
 void *task_get_class_data (task_pid_t pid)
 {
-	int i;
+	int slot = task_slot_of (pid);
 
-	for (i=0; i < NUM_TASKS; i++)
-		if (task_data_table[i].pid == pid)
-			return task_data_table[i].class_data;
-	printf ("task_get_class_data for pid %u failed\n", (unsigned)pid);
-	fatal (0xFD);
+	if (slot == -1)
+	{
+		printf ("task_get_class_data for pid %u failed\n", (unsigned)pid);
+		fatal (0xFD);
+	}
+	return task_data_table[slot].class_data;
 }
 
 void task_set_class_data (task_pid_t pid, size_t size)
@@ -390,15 +647,21 @@ void task_set_class_data (task_pid_t pid, size_t size)
 
 void task_init (void)
 {
+	int i;
+
 	memset (task_data_table, 0, sizeof (task_data_table));
 
 	struct sched_param sched_param;
 	sched_param.sched_priority = 1;
 	sched_setscheduler (0, SCHED_FIFO, &sched_param);
 
+	task_index_init ();
+
 	task_data_table[0].pid = task_getpid ();
 	task_data_table[0].gid = GID_FIRST_TASK;
 	task_data_table[0].duration = TASK_DURATION_INF;
+	task_index_insert (0);
+	task_self_slot = 0;
 
 	pthread_attr_init (&attr_default);
 
@@ -416,4 +679,8 @@ void task_init (void)
 	attr_interrupt = attr_task;
 	sched_param.sched_priority = 8;
 	pthread_attr_setschedparam (&attr_interrupt, &sched_param);
+
+	/* Fill the worker pool */
+	for (i=0; i < TASK_POOL_PRESPAWN; i++)
+		task_worker_spawn (&attr_task, NULL, -1);
 }
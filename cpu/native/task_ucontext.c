@@ -0,0 +1,438 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <ucontext.h>
+#include <freewpc.h>
+#include <printf.h>
+#include <native/log.h>
+#include <simulation.h>
+
+/**
+ * \file
+ * \brief This module implements the round-robin, non-preemptive task
+ * scheduler under Linux, using ucontext to switch between tasks on a single
+ * OS thread.
+ *
+ * Unlike the pth and pthreads versions, nothing here depends on the host
+ * scheduler or on wall time.  Tasks are dispatched in table order, in the
+ * same way as the 6809 task_dispatcher(), and sleeps are measured in
+ * simulated milliseconds from realtime_read().  The realtime task is itself
+ * an ordinary task that advances the clock by 1ms each time it runs, so
+ * given the same inputs, every run produces the same result.
+ */
+
+/** Enable this to turn on verbose debugging of the task subsystem. */
+//#define UCONTEXT_DEBUG
+
+#ifdef UCONTEXT_DEBUG
+#define ucontext_debug(args...) print_log(args)
+#else
+#define ucontext_debug(args...)
+#endif
+
+/** The size of each task's stack.  Native code is much less careful
+ * about stack usage than 6809 code, so this is generous. */
+#define TASK_STACK_BYTES (256 * 1024)
+
+/** Values for the 'state' field in the task structure */
+#define TASK_FREE 0x0
+#define TASK_USED 0x1
+#define TASK_BLOCKED 0x2
+
+/* Says that the task killed itself, and should exit at its next
+ * opportunity.  Its stack is still in use until then, so the
+ * entry cannot be reallocated. */
+#define TASK_KILLED 0x4
+
+bool task_dispatching_ok = TRUE;
+
+U8 task_largest_stack = 0;
+
+U8 task_count = 0;
+
+U8 task_max_count = 0;
+
+#ifdef CONFIG_SIM
+extern void ui_write_task (int, task_gid_t);
+#endif
+
+/** The native task structure */
+struct ucontext_task
+{
+	U8 state;
+	task_gid_t gid;
+	PTR_OR_U16 arg;
+	U8 duration;
+	unsigned char class_data[32];
+
+	/** The simulated time, in milliseconds, at which a blocked task
+	 * should be awakened */
+	unsigned long wakeup;
+
+	/** The task's entry point */
+	task_function_t fn;
+
+	/** The saved CPU context, while the task is not running */
+	ucontext_t ctx;
+
+	/** The task's stack.  It is allocated on first use and then kept
+	 * for later tasks that reuse the same entry. */
+	void *stack;
+};
+
+typedef struct ucontext_task aux_task_data_t;
+
+aux_task_data_t task_data_table[NUM_TASKS];
+
+/** The task that is running now */
+static task_pid_t task_current;
+
+/** The context of the dispatcher, which runs between tasks */
+static ucontext_t task_dispatch_ctx;
+
+/** The dispatcher's stack */
+static void *task_dispatch_stack;
+
+
+#define task_slot(tp)   ((tp) - task_data_table)
+
+#define task_live_p(tp)	(((tp)->state & (TASK_USED|TASK_KILLED)) == TASK_USED)
+
+
+void task_dump (void)
+{
+#ifdef DEBUGGER
+	int i;
+	dbprintf ("PID         GID   ARG    FLAGS  WAKEUP\n");
+	for (i=0; i < NUM_TASKS; i++)
+	{
+		aux_task_data_t *td = &task_data_table[i];
+
+		if (td->state != TASK_FREE)
+		{
+			dbprintf ("%p%c   %d    %08X   %02X  %ld\n",
+				td, (td == task_current) ? '*' : ' ',
+				td->gid, td->arg.u16, td->duration, td->wakeup);
+		}
+	}
+#endif
+}
+
+
+void idle_profile_rtt (void)
+{
+}
+
+
+/**
+ * The task dispatcher.  This runs in its own context, and is entered
+ * whenever a task sleeps or exits.
+ *
+ * The search for the next task starts with the entry after the one that
+ * just ran, and wraps around at the end of the table.  Periodic functions
+ * are not called here as on the 6809; realtime_tick() already runs them
+ * from the realtime task.
+ */
+static void task_dispatch_loop (void)
+{
+	aux_task_data_t *tp = task_current;
+
+	for (;;)
+	{
+		task_dispatching_ok = TRUE;
+
+		if (++tp == &task_data_table[NUM_TASKS])
+			tp = &task_data_table[0];
+
+		if (!(tp->state & TASK_USED))
+			continue;
+
+		if (tp->state & TASK_BLOCKED)
+		{
+			if (realtime_read () >= tp->wakeup)
+				tp->state &= ~TASK_BLOCKED;
+			else
+				continue;
+		}
+
+		task_current = tp;
+		swapcontext (&task_dispatch_ctx, &tp->ctx);
+	}
+}
+
+
+/** Save the current task and switch to the dispatcher.  This returns
+ * when the dispatcher selects the task again. */
+static void task_save (void)
+{
+	aux_task_data_t *tp = task_current;
+
+	if (tp->state & TASK_KILLED)
+		task_exit ();
+	swapcontext (&tp->ctx, &task_dispatch_ctx);
+}
+
+
+/**
+ * The entry point for every new task.  If the task function returns,
+ * the task exits normally.
+ */
+static void task_entry (void)
+{
+	task_current->fn ();
+	task_exit ();
+}
+
+
+/**
+ * The main function for creating a new task.
+ */
+task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
+{
+	aux_task_data_t *tp;
+
+	ucontext_debug ("task_create_gid: gid=%d, fn=%p\n", gid, fn);
+
+	for (tp = task_data_table; tp < &task_data_table[NUM_TASKS]; tp++)
+		if (tp->state == TASK_FREE)
+			break;
+	if (tp == &task_data_table[NUM_TASKS])
+		fatal (ERR_NO_FREE_TASKS);
+
+	if (tp->stack == NULL)
+	{
+		tp->stack = malloc (TASK_STACK_BYTES);
+		if (tp->stack == NULL)
+			fatal (ERR_NO_FREE_TASKS);
+	}
+
+	getcontext (&tp->ctx);
+	tp->ctx.uc_stack.ss_sp = tp->stack;
+	tp->ctx.uc_stack.ss_size = TASK_STACK_BYTES;
+	tp->ctx.uc_link = NULL;
+	makecontext (&tp->ctx, task_entry, 0);
+
+	tp->state = TASK_USED;
+	tp->gid = gid;
+	tp->fn = fn;
+	tp->wakeup = 0;
+	tp->arg.u16 = 0;
+	tp->duration = TASK_DURATION_BALL;
+#ifdef CONFIG_SIM
+	ui_write_task (task_slot (tp), gid);
+#endif
+	return (tp);
+}
+
+
+void task_setgid (task_gid_t gid)
+{
+	task_current->gid = gid;
+}
+
+
+void task_sleep (task_ticks_t ticks)
+{
+	aux_task_data_t *tp = task_current;
+	tp->wakeup = realtime_read () + ticks * IRQS_PER_TICK;
+	tp->state |= TASK_BLOCKED;
+	task_save ();
+}
+
+
+void task_sleep_sec1 (U8 secs)
+{
+	aux_task_data_t *tp = task_current;
+	tp->wakeup = realtime_read () + (unsigned long)secs * TIME_1S * IRQS_PER_TICK;
+	tp->state |= TASK_BLOCKED;
+	task_save ();
+}
+
+
+__noreturn__
+void task_exit (void)
+{
+	aux_task_data_t *tp = task_current;
+
+	ucontext_debug ("task_exit: pid=%p\n", tp);
+	tp->state = TASK_FREE;
+#ifdef CONFIG_SIM
+	ui_write_task (task_slot (tp), 0);
+#endif
+	/* Nothing else can run before the dispatcher takes over, so it is
+	safe to keep using this task's stack until then. */
+	for (;;)
+		setcontext (&task_dispatch_ctx);
+}
+
+
+task_pid_t task_find_gid_next (task_pid_t last, task_gid_t gid)
+{
+	aux_task_data_t *tp;
+	for (tp = last+1; tp < &task_data_table[NUM_TASKS]; tp++)
+		if (task_live_p (tp) && (tp->gid == gid))
+			return (tp);
+	return NULL;
+}
+
+
+task_pid_t task_find_gid (task_gid_t gid)
+{
+	return task_find_gid_next (task_data_table-1, gid);
+}
+
+
+task_gid_t task_pid_gid (task_pid_t tp)
+{
+	if (task_live_p (tp))
+		return tp->gid;
+	return 0;
+}
+
+
+void task_kill_pid (task_pid_t tp)
+{
+	ucontext_debug ("task_kill_pid: pid=%p\n", tp);
+
+	if (!task_live_p (tp))
+		return;
+
+	/* A task cannot be freed while it is still running on its own stack.
+	Let it exit the next time that it tries to sleep. */
+	if (tp == task_current)
+		tp->state |= TASK_KILLED;
+	else
+		tp->state = TASK_FREE;
+#ifdef CONFIG_SIM
+	ui_write_task (task_slot (tp), 0);
+#endif
+}
+
+
+bool task_kill_gid (task_gid_t gid)
+{
+	aux_task_data_t *tp;
+	bool rc = FALSE;
+
+	for (tp = task_data_table; tp < &task_data_table[NUM_TASKS]; tp++)
+		if ((tp != task_current) && task_live_p (tp) && (tp->gid == gid))
+		{
+			task_kill_pid (tp);
+			rc = TRUE;
+		}
+	return (rc);
+}
+
+
+void task_duration_expire (U8 cond)
+{
+	aux_task_data_t *tp;
+
+	for (tp = task_data_table; tp < &task_data_table[NUM_TASKS]; tp++)
+		if (task_live_p (tp) && (tp->duration & cond))
+			task_kill_pid (tp);
+}
+
+
+void task_set_duration (task_pid_t tp, U8 cond)
+{
+	tp->duration = cond;
+}
+
+
+void task_add_duration (U8 flags)
+{
+	task_current->duration |= flags;
+}
+
+
+void task_remove_duration (U8 flags)
+{
+	task_current->duration &= ~flags;
+}
+
+
+U16 task_get_arg (void)
+{
+	return task_current->arg.u16;
+}
+
+
+void *task_get_pointer_arg (void)
+{
+	return task_current->arg.ptr;
+}
+
+
+void task_set_arg (task_pid_t tp, U16 arg)
+{
+	tp->arg.u16 = arg;
+}
+
+
+void task_set_pointer_arg (task_pid_t tp, void *arg)
+{
+	tp->arg.ptr = arg;
+}
+
+
+task_pid_t task_getpid (void)
+{
+	return task_current;
+}
+
+
+task_gid_t task_getgid (void)
+{
+	return task_current->gid;
+}
+
+
+void *task_get_class_data (task_pid_t pid)
+{
+	return pid->class_data;
+}
+
+void task_set_class_data (task_pid_t pid, size_t size)
+{
+}
+
+
+/**
+ * Initialize the task subsystem.  The caller becomes the first task,
+ * running on the original process stack.
+ */
+void task_init (void)
+{
+	memset (task_data_table, 0, sizeof (task_data_table));
+
+	task_dispatch_stack = malloc (TASK_STACK_BYTES);
+	getcontext (&task_dispatch_ctx);
+	task_dispatch_ctx.uc_stack.ss_sp = task_dispatch_stack;
+	task_dispatch_ctx.uc_stack.ss_size = TASK_STACK_BYTES;
+	task_dispatch_ctx.uc_link = NULL;
+	makecontext (&task_dispatch_ctx, task_dispatch_loop, 0);
+
+	task_current = &task_data_table[0];
+	task_current->state = TASK_USED;
+	task_current->gid = GID_FIRST_TASK;
+	task_current->duration = TASK_DURATION_INF;
+}
@@ -23,19 +23,34 @@
 
 #ifndef GENCALLSET
 
+/* Generated by gencallset: CALLSET_HAS_xxx for every event, and
+the names of events which share another event's handler. */
+#include <callset_events.h>
+
 #define CALLSET_ENTRY(module,set,...) \
 	void module ## _ ## set (void)
 
 #define CALLSET_BOOL_ENTRY(module,set) \
 	bool module ## _ ## set (void)
 
-#define callset_invoke(set)	SECTION_VOIDCALL(__event__, callset_ ## set)
+/* Like CALLSET_ENTRY, but says when the entry is called relative to the
+others for the same event.  Lower priorities are called first; plain
+entries have priority 0.  The priority must be an integer constant. */
+#define CALLSET_PRIORITY_ENTRY(module,priority,set,...) \
+	void module ## _ ## set (void)
+
+/* Events that nobody catches are compiled out entirely. */
+#define callset_invoke(set) \
+do { \
+	if (CALLSET_HAS_ ## set) \
+		SECTION_VOIDCALL(__event__, callset_ ## set); \
+} while (0)
 
 #define callset_invoke_boolean(set)	\
-({ \
+(CALLSET_HAS_ ## set ? ({ \
 	extern __event__ bool callset_ ## set (void); \
 	callset_ ## set (); \
-})
+}) : TRUE)
 
 /* WARNING : this function won't work if the caller is in a different page
 from EVENT_PAGE. */
@@ -60,6 +75,50 @@ from EVENT_PAGE. */
 #define callset_debug(id) do { extern U16 log_callset; log_callset = id; } while (0)
 #endif
 
+#ifdef CONFIG_CALLSET_PROFILE
+
+/* When CONFIG_CALLSET_PROFILE is enabled, gencallset times every call to
+an event handler.  Natively, times are measured with the host clock in
+microseconds.  On the 6809, they are measured in IRQs, roughly 1ms each,
+so short handlers are only seen in proportion to how often an IRQ
+happens to land in them; averages over many calls are still useful. */
+
+#ifdef CONFIG_NATIVE
+typedef U32 callset_profile_time_t;
+extern unsigned long realtime_profile_read (void);
+#define callset_profile_clock() (realtime_profile_read () / 1000)
+#define CALLSET_PROFILE_UNITS_PER_MS 1000
+#define CALLSET_PROFILE_UNITS "US"
+#else
+typedef U16 callset_profile_time_t;
+extern __fastram__ U16 callset_profile_irqs;
+#define callset_profile_clock() callset_profile_irqs
+#define CALLSET_PROFILE_UNITS_PER_MS 1
+#define CALLSET_PROFILE_UNITS "MS"
+#endif
+
+/** Measurements for one pair of event and module */
+struct callset_profile
+{
+	U16 count;
+	callset_profile_time_t worst;
+	U32 total;
+};
+
+/** The number of calls shown, slowest first, by the profile reports */
+#define CALLSET_PROFILE_TOP 32
+
+extern struct callset_profile callset_profile_table[];
+
+void callset_profile_end (U16 slot, callset_profile_time_t start);
+__event__ void callset_profile_name (U16 slot);
+callset_profile_time_t callset_profile_average (U16 slot);
+U8 callset_profile_rank (U16 *order, U8 max);
+void callset_profile_reset (void);
+void callset_profile_dump (void);
+
+#endif /* CONFIG_CALLSET_PROFILE */
+
 #endif /* GENCALLSET */
 
 #endif /* _CALLSET_H */
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HWSIM_SIGFILE_H
+#define _HWSIM_SIGFILE_H
+
+/*	The binary signal capture format.  This is written by sim/signal.c
+	when 'capture format binary' is given, and can be converted back to
+	the text format with tools/sigconv.
+
+	All multibyte integers are written as varints: 7 bits per byte,
+	least significant group first, with the high bit set on every byte
+	except the last.
+
+	The file begins with a header:
+		4 bytes : the magic string SIGFILE_MAGIC
+		1 byte  : SIGFILE_VERSION
+		varint  : the number of columns, at most SIGFILE_MAX_COLUMNS
+		varint  : the signal number for each column
+
+	It is followed by any number of records:
+		varint  : milliseconds since the previous record.  For the first
+		          record, this is the absolute time instead.
+		varint  : a bitmask of the columns whose values are given
+		values  : for each bit set in the mask, lowest first, the new
+		          value of that column.  Binary signals are 1 byte
+		          (0 or 1); auto signals are a 4-byte little-endian
+		          IEEE float.
+
+	A record is only written when some value changed, and all columns
+	hold their previous values in between.  A record with an empty mask
+	marks the end of a capture, so that the converter knows how long the
+	last values were held.  If the capture is started again, a new header
+	follows. */
+
+#define SIGFILE_MAGIC "FWSC"
+#define SIGFILE_VERSION 1
+#define SIGFILE_MAX_COLUMNS 32
+
+#endif /* _HWSIM_SIGFILE_H */
@@ -48,5 +48,88 @@ extern inline void advance_time_rtt (void)
 /** Called at the end of every IRQ */
 extern inline void do_irq_end (void)
 {
+#if defined(CONFIG_CALLSET_PROFILE) && !defined(CONFIG_NATIVE)
+	callset_profile_irqs++;
+#endif
+}
+
+
+#ifdef CONFIG_SCHED_PROFILE
+
+/* When CONFIG_SCHED_PROFILE is enabled, the scheduler generates code
+that times every call made from the IRQ handler.  On the 6809, times
+are measured with the peripheral timer and kept in CPU cycles.  In
+native mode, they are measured with the host clock in nanoseconds.
+
+rtt_profile_clock() reads the raw clock; rtt_profile_elapsed() gives the
+time since an earlier reading.  The 6809 timer is only 8 bits wide, so
+the difference is taken in timer counts, where a wrap during the
+measurement cancels out, and then scaled to cycles. */
+
+#ifdef CONFIG_NATIVE
+typedef U32 rtt_profile_time_t;
+typedef U32 rtt_profile_stamp_t;
+extern unsigned long realtime_profile_read (void);
+#define rtt_profile_clock() ((rtt_profile_stamp_t)realtime_profile_read ())
+#define rtt_profile_elapsed(start) \
+	((rtt_profile_time_t)(rtt_profile_clock () - (start)))
+#else
+typedef U16 rtt_profile_time_t;
+typedef U8 rtt_profile_stamp_t;
+#define rtt_profile_clock() ((rtt_profile_stamp_t)(0 - pinio_read_timer (0)))
+#define rtt_profile_elapsed(start) \
+	((rtt_profile_time_t)(U8)(rtt_profile_clock () - (start)) \
+		* PINIO_TIMER_CYCLES_PER_COUNT)
+#endif
+
+/** Measurements for one call from the IRQ handler */
+struct rtt_profile
+{
+	rtt_profile_time_t worst;
+	U16 count;
+	U32 total;
+};
+
+/** Static information about each profiled call, written by the
+scheduler alongside the code */
+struct rtt_profile_info
+{
+	const char *name;
+	U8 tick;
+	U8 divider;
+	U16 estimate;
+};
+
+extern rtt_profile_stamp_t rtt_profile_start;
+extern struct rtt_profile tick_profile[];
+extern const struct rtt_profile_info tick_profile_info[];
+extern const U8 tick_profile_slots;
+extern const U16 tick_profile_cycles_per_tick;
+
+void rtt_profile_reset (void);
+void rtt_profile_dump (void);
+
+/** Start timing the first call in an IRQ */
+extern inline void rtt_profile_begin (void)
+{
+	rtt_profile_start = rtt_profile_clock ();
+}
+
+/** Finish timing a call, and start timing the next one.  The time
+taken here is not charged to either call. */
+extern inline void rtt_profile_end (struct rtt_profile *prof)
+{
+	rtt_profile_time_t len = rtt_profile_elapsed (rtt_profile_start);
+	if (len > prof->worst)
+		prof->worst = len;
+	if (prof->count == 0xFFFF)
+	{
+		prof->count /= 2;
+		prof->total /= 2;
+	}
+	prof->count++;
+	prof->total += len;
+	rtt_profile_start = rtt_profile_clock ();
 }
 
+#endif /* CONFIG_SCHED_PROFILE */
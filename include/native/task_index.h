@@ -0,0 +1,138 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __NATIVE_TASK_INDEX_H
+#define __NATIVE_TASK_INDEX_H
+
+/*
+ * The gid and pid indices over the task table, shared by the pth and
+ * pthread task backends.  Before including this file, a backend must
+ * typedef task_index_pid_t to its pid type, and declare its
+ * aux_task_data_t with pid, gid, gid_prev, gid_next and pid_next fields
+ * and task_data_table[].  The caller provides any locking.
+ */
+
+/** The number of buckets in the gid index.  Group IDs are small, so
+ * each gid normally has a bucket to itself. */
+#define TASK_GID_BUCKETS 256
+
+/** The number of buckets in the pid index */
+#define TASK_PID_BUCKETS 64
+
+#define task_gid_bucket(gid) ((gid) & (TASK_GID_BUCKETS - 1))
+
+/** The first task slot in each gid bucket, or -1 */
+static int task_gid_head[TASK_GID_BUCKETS];
+
+/** The first task slot in each pid bucket, or -1 */
+static int task_pid_head[TASK_PID_BUCKETS];
+
+
+static inline unsigned int task_pid_bucket (task_index_pid_t pid)
+{
+	unsigned long h = (unsigned long)pid;
+	h ^= (h >> 7) ^ (h >> 13) ^ (h >> 23);
+	return h & (TASK_PID_BUCKETS - 1);
+}
+
+
+/** Empty both indices. */
+static void task_index_init (void)
+{
+	int i;
+
+	for (i=0; i < TASK_GID_BUCKETS; i++)
+		task_gid_head[i] = -1;
+	for (i=0; i < TASK_PID_BUCKETS; i++)
+		task_pid_head[i] = -1;
+}
+
+
+/** Add a task slot to the gid bucket for its current gid. */
+static void task_index_link_gid (int slot)
+{
+	aux_task_data_t *td = &task_data_table[slot];
+	int *gid_head = &task_gid_head[task_gid_bucket (td->gid)];
+
+	td->gid_prev = -1;
+	td->gid_next = *gid_head;
+	if (*gid_head != -1)
+		task_data_table[*gid_head].gid_prev = slot;
+	*gid_head = slot;
+}
+
+
+/** Remove a task slot from the gid bucket it is on. */
+static void task_index_unlink_gid (int slot)
+{
+	aux_task_data_t *td = &task_data_table[slot];
+
+	if (td->gid_prev != -1)
+		task_data_table[td->gid_prev].gid_next = td->gid_next;
+	else
+		task_gid_head[task_gid_bucket (td->gid)] = td->gid_next;
+	if (td->gid_next != -1)
+		task_data_table[td->gid_next].gid_prev = td->gid_prev;
+}
+
+
+/** Add a newly filled task slot to the gid and pid indices. */
+static void task_index_insert (int slot)
+{
+	aux_task_data_t *td = &task_data_table[slot];
+	int *pid_head = &task_pid_head[task_pid_bucket (td->pid)];
+
+	task_index_link_gid (slot);
+	td->pid_next = *pid_head;
+	*pid_head = slot;
+}
+
+
+/** Remove a task slot from the gid and pid indices. */
+static void task_index_remove (int slot)
+{
+	aux_task_data_t *td = &task_data_table[slot];
+	int *link;
+
+	task_index_unlink_gid (slot);
+	for (link = &task_pid_head[task_pid_bucket (td->pid)];
+		*link != -1; link = &task_data_table[*link].pid_next)
+		if (*link == slot)
+		{
+			*link = td->pid_next;
+			break;
+		}
+}
+
+
+/** Return the task table slot for a pid from the pid index, or -1
+ * if it is not running. */
+static int task_index_find_pid (task_index_pid_t pid)
+{
+	int slot;
+
+	for (slot = task_pid_head[task_pid_bucket (pid)];
+		slot != -1; slot = task_data_table[slot].pid_next)
+		if (task_data_table[slot].pid == pid)
+			return slot;
+	return -1;
+}
+
+#endif /* __NATIVE_TASK_INDEX_H */
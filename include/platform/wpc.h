@@ -870,6 +870,10 @@ extern inline U8 pinio_read_dedicated_switches (void)
 /* Precision Timer                          */
 /********************************************/
 
+/** The timer is an 8-bit down counter.  This is the number of CPU
+cycles per count, used to convert timer readings into cycles. */
+#define PINIO_TIMER_CYCLES_PER_COUNT 16
+
 extern inline U8 pinio_read_timer (U8 timerno)
 {
 	return readb (WPC_PERIPHERAL_TIMER_FIRQ_CLEAR);
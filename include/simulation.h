@@ -51,6 +51,7 @@ typedef unsigned long simulated_time_interval_t;
 struct time_handler
 {
 	struct time_handler *next;
+	simulated_time_interval_t expires;
 	int periodicity;
 	time_handler_t fn;
 	void *data;
@@ -34,6 +34,22 @@ extern U8 single_bit_set_array[];
 
 #define bitarray_const_offset(bits, bitno) (bits[(bitno) / 8])
 
+/* Return the number of the lowest bit set in a nonzero byte.  Together
+ * with 'v &= v - 1', which clears that bit, this visits only the bits
+ * that are set, instead of shifting through every position. */
+#ifdef CONFIG_NATIVE
+#define low_bit_number(v) __builtin_ctz (v)
+#else
+extern const U8 low_bit_nibble_array[];
+extern inline U8 low_bit_number (U8 v)
+{
+	if (v & 0x0F)
+		return low_bit_nibble_array[v & 0x0F];
+	else
+		return 4 + low_bit_nibble_array[v >> 4];
+}
+#endif
+
 #define bitarray_const_mask(bits, bitno) single_bit_set ((bitno) % 8)
 
 /* Non-optimized macros for twiddling bits.
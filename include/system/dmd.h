@@ -89,49 +89,64 @@
 typedef U8 *dmd_buffer_t;
 
 
+/** One drawing operation of a DMD transition.  It copies a rectangle
+ * of bytes from the old or new image into the composite page, through
+ * a mask.  The operations for each frame are generated at build time
+ * by tools/gentrans. */
+struct dmd_trans_op
+{
+	/** Where the data comes from, and whether this ends the frame */
+	U8 flags;
+
+	/** Which bits of each byte are copied */
+	U8 mask;
+
+	/** The size of the rectangle, in bytes and rows */
+	U8 width;
+	U8 height;
+
+	/** The byte offsets of the rectangle in the composite page and
+	 * in the source page */
+	U16 dst;
+	U16 src;
+};
+
+#define DMD_TRANS_OLD   0x0
+#define DMD_TRANS_NEW   0x1
+#define DMD_TRANS_LAST  0x80
+
+
 /** A DMD transition describes all of the properties of a
- * transition, such as the functions that render each
+ * transition, such as the operations that render each
  * successive frame change, timing, etc.
  */
 typedef struct
 {
-	/** Initialization function */
-	void (*composite_init) (void);
-
-	/** Render the part of the transitional image that comes from
-	 * the previous image. */
-	void (*composite_old) (void);
-
-	/** Render the part of the transitional image that comes from
-	 * the new image.   This function is also responsible for
-	 * determining when the transition is finished; it should
-	 * dmd_in_transition to FALSE when this happens.
-	 */
-	void (*composite_new) (void);
+	/** The drawing operations for all of the frames, in order */
+	const struct dmd_trans_op *ops;
 
 	/** A parameter that determines how fast the transition occurs.
 	 * This is the delay between transitional frames, and is given
 	 * as a TIME_xxx define. */
 	U8 delay;
 
-	/** Extra data used to create multiple transitions using common
-	 * code but with slight differences.  Each transition interprets
-	 * this field differently.  It could be used to hold a pointer or
-	 * an offset, so a union is used. */
-	union {
-		U16 u16;
-		void *ptr;
-	} arg;
-
-	/** Number of iterations in the transition */
+	/** Number of frames in the transition */
 	U8 count;
+
+	/** DMD_TRANS_IN_PLACE if each frame only adds to the previous one */
+	U8 flags;
 } dmd_transition_t;
 
+#define DMD_TRANS_IN_PLACE 0x1
 
-#define dmd_low_buffer			((dmd_buffer_t)pinio_dmd_window_ptr (PINIO_DMD_WINDOW_0))
-#define dmd_high_buffer			((dmd_buffer_t)pinio_dmd_window_ptr (PINIO_DMD_WINDOW_1))
 
-extern U8 *dmd_trans_data_ptr;
+/** The raw addresses of the two mapped DMD windows.  Writes made
+ * through these are not seen by dirty row tracking; use
+ * dmd_low_buffer/dmd_high_buffer unless the rows written are
+ * marked with dmd_dirty_mark(). */
+#define dmd_low_window			((dmd_buffer_t)pinio_dmd_window_ptr (PINIO_DMD_WINDOW_0))
+#define dmd_high_window		((dmd_buffer_t)pinio_dmd_window_ptr (PINIO_DMD_WINDOW_1))
+
 extern bool dmd_in_transition;
 extern dmd_transition_t *dmd_transition;
 extern dmd_pagepair_t dmd_visible_pages;
@@ -141,6 +156,76 @@ extern dmd_pagepair_t dmd_visible_pages;
 #define dmd_dark_page dmd_visible_pages.u.first
 #define dmd_bright_page dmd_visible_pages.u.second
 
+#ifdef CONFIG_DMD_DIRTY_ROWS
+
+/** The range of rows on a DMD page that may have pixels set.
+ * All rows outside of first..last are known to be blank.  An empty
+ * range is stored as first > last. */
+struct dmd_dirty_rows
+{
+	U8 first;
+	U8 last;
+};
+
+extern struct dmd_dirty_rows dmd_dirty[];
+
+/** Note that HEIGHT rows starting at row Y of PAGE may have been drawn. */
+extern inline void dmd_dirty_mark (dmd_pagenum_t page, U8 y, U8 height)
+{
+	struct dmd_dirty_rows *dirty = &dmd_dirty[page];
+	if (height == 0)
+		return;
+	if (y < dirty->first)
+		dirty->first = y;
+	y += height - 1;
+	if (y >= PINIO_DMD_HEIGHT)
+		y = PINIO_DMD_HEIGHT - 1;
+	if (y > dirty->last)
+		dirty->last = y;
+}
+
+/** Note that any row of PAGE may have been drawn. */
+extern inline void dmd_dirty_all (dmd_pagenum_t page)
+{
+	dmd_dirty[page].first = 0;
+	dmd_dirty[page].last = PINIO_DMD_HEIGHT - 1;
+}
+
+/** Note that PAGE is entirely blank. */
+extern inline void dmd_dirty_clear (dmd_pagenum_t page)
+{
+	dmd_dirty[page].first = PINIO_DMD_HEIGHT;
+	dmd_dirty[page].last = 0;
+}
+
+/** Note that SRC has been ORed or XORed into DST. */
+extern inline void dmd_dirty_merge (dmd_pagenum_t dst, dmd_pagenum_t src)
+{
+	if (dmd_dirty[src].first < dmd_dirty[dst].first)
+		dmd_dirty[dst].first = dmd_dirty[src].first;
+	if (dmd_dirty[src].last > dmd_dirty[dst].last)
+		dmd_dirty[dst].last = dmd_dirty[src].last;
+}
+
+/* Code which takes the address of a mapped page may write anywhere
+ * on it, so the whole page is considered dirty. */
+#define dmd_low_buffer \
+	((dmd_buffer_t)(dmd_dirty_all (dmd_low_page), dmd_low_window))
+#define dmd_high_buffer \
+	((dmd_buffer_t)(dmd_dirty_all (dmd_high_page), dmd_high_window))
+
+#else
+
+#define dmd_dirty_mark(page, y, height) do {} while (0)
+#define dmd_dirty_all(page) do {} while (0)
+#define dmd_dirty_clear(page) do {} while (0)
+#define dmd_dirty_merge(dst, src) do {} while (0)
+
+#define dmd_low_buffer dmd_low_window
+#define dmd_high_buffer dmd_high_window
+
+#endif /* CONFIG_DMD_DIRTY_ROWS */
+
 extern dmd_transition_t 
 	trans_scroll_up,
 	trans_scroll_up_avg,
@@ -227,6 +312,7 @@ void dmd_reset_transition (void);
 void frame_draw (U16 id);
 void frame_draw2 (U16 id);
 void frame_draw_plane (U16 id);
+bool frame_is_delta (U16 id);
 void bmp_draw (U8 x, U8 y, U16 id);
 
 __transition__ void dmd_text_outline (void);
@@ -236,6 +322,8 @@ __transition__ void dmd_overlay_outline (void);
 __transition__ void dmd_overlay_color (void);
 __transition__ void dmd_overlay_onto_color (void);
 __transition__ void dmd_dup_mapped (void);
+__transition__ const struct dmd_trans_op *dmd_trans_draw (
+	const struct dmd_trans_op *op, U8 old_page, U8 new_page);
 
 __effect__ void dmd_draw_border (U8 *dbuf);
 __effect__ void dmd_draw_thin_border (U8 *dbuf);
@@ -247,13 +335,15 @@ void dmd_xor_page (void);
 #ifdef __m6809__
 void frame_decode_rle_asm (U8 *);
 void frame_decode_sparse_asm (U8 *);
+void frame_decode_delta_asm (U8 *);
 void dmd_copy_asm (dmd_buffer_t, dmd_buffer_t);
 #define frame_decode_rle frame_decode_rle_asm
 #define frame_decode_sparse frame_decode_sparse_asm
+#define frame_decode_delta frame_decode_delta_asm
 #else
-/* TODO - no C versions for some of these */
 #define frame_decode_rle frame_decode_rle_c
-#define frame_decode_sparse(p)
+#define frame_decode_sparse frame_decode_sparse_c
+#define frame_decode_delta frame_decode_delta_c
 #endif
 
 extern inline void dmd_map_overlay (void)
@@ -288,6 +378,7 @@ struct dmd_rough_args
 		dmd_rough_args.dst = pinio_dmd_window_ptr (PINIO_DMD_WINDOW_1) + \
 			((x) / CHAR_BIT) + (U16)(y) * DMD_BYTE_WIDTH; \
 		dmd_rough_args.size.xy = MKCOORD1 ((w) / CHAR_BIT, (h)); \
+		dmd_dirty_mark (dmd_high_page, (y), (h)); \
 		dmd_rough_copy1 (); \
 	} while (0)
 
@@ -328,6 +419,7 @@ __transition__ void dmd_rough_erase1 (void);
 		dmd_rough_args.dst = pinio_dmd_window_ptr (PINIO_DMD_WINDOW_0) + \
 			((x) / CHAR_BIT) + (y) * DMD_BYTE_WIDTH; \
 		dmd_rough_args.size.xy = MKCOORD1 ((w) / CHAR_BIT, (h)); \
+		dmd_dirty_mark (dmd_low_page, (y), (h)); \
 		dmd_rough_invert1 (); \
 	} while (0)
 
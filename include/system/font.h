@@ -46,6 +46,23 @@ typedef struct font
 
 
 
+#ifdef CONFIG_FONT_CACHE
+/** The number of rendered strings kept by the font cache */
+#ifndef FONT_CACHE_ENTRIES
+#define FONT_CACHE_ENTRIES 4
+#endif
+
+/** The longest string that can be cached */
+#define FONT_CACHE_STRING_LEN 15
+
+/** The largest bitmap that can be cached, in bytes.  This
+ * fits a score in font_lucida9. */
+#ifndef FONT_CACHE_DATA_SIZE
+#define FONT_CACHE_DATA_SIZE 192
+#endif
+#endif /* CONFIG_FONT_CACHE */
+
+
 /**
  * An identifier for a symbol, which is just a character within the
  * special symbol font.
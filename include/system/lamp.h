@@ -167,13 +167,51 @@ void lamplist_rotate_next (lamplist_id_t id, bitset matrix);
 void lamplist_rotate_previous (lamplist_id_t id, bitset matrix);
 void lamplist_set_count (lamplist_id_t set, U8 count);
 bool lamplist_test_all (lamplist_id_t id, lamp_boolean_operator_t op);
+bool lamplist_test_any (lamplist_id_t id, lamp_boolean_operator_t op);
 
 __attribute__((noinline)) void lamp_set_on (lamp_set matrix);
 
+#ifdef CONFIG_LAMP_FADE
+/** The number of bit planes used for lamp brightness */
+#define LAMP_FADE_PLANES 3
+
+/** The number of ticks in which every plane is shown */
+#define LAMP_FADE_PHASES ((1 << LAMP_FADE_PLANES) - 1)
+
+/** The brightest level for a lamp */
+#define LAMP_BRIGHTNESS_MAX ((1 << LAMP_FADE_PLANES) - 1)
+
+/** The number of lamps which can be fading at once */
+#ifndef LAMP_FADE_SLOTS
+#define LAMP_FADE_SLOTS 8
+#endif
+
+/** The most lamps whose brightness is changed in one tick */
+#ifndef LAMP_FADE_STEPS
+#define LAMP_FADE_STEPS 2
+#endif
+
+void lamp_fade_next_plane (void);
+void lamp_fade_rtt (void);
+U8 lamp_brightness_get (lampnum_t lamp);
+void lamp_brightness_set (lampnum_t lamp, U8 level);
+void lamp_fade (lampnum_t lamp, U8 level, U8 ticks);
+void lamplist_fade (lamplist_id_t id, U8 level, U8 ticks);
+void lamp_fade_all_off (void);
+void lamp_fade_init (void);
+#endif /* CONFIG_LAMP_FADE */
+
+#ifdef CONFIG_LAMP_STROBE_SCHEDULE
+/** The lamp column to strobe in each slot of a frame */
+extern const U8 lamp_strobe_schedule[MACHINE_LAMP_STROBE_SLOTS];
+#endif
+
 void lamp_set_zero (lamp_set dst);
 void lamp_set_copy (lamp_set dst, const lamp_set src);
 void lamp_set_add (lamp_set dst, const lamp_set src);
 void lamp_set_subtract (lamp_set dst, const lamp_set src);
+void lamp_set_toggle (lamp_set dst, const lamp_set src);
 bool lamp_set_disjoint (const lamp_set a, const lamp_set b);
+bool lamp_set_contains (const lamp_set set, const lamp_set subset);
 
 #endif /* _SYS_LAMP_H */
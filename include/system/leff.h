@@ -45,6 +45,11 @@ typedef void (*leff_function_t) (void);
  */
 #define L_SHARED 0x2
 
+/** A program leff is not a function, but a leff program which is run by
+ * the leff interpreter (see leffprog.c).  This is set automatically for
+ * leffs declared with 'program' in the machine description. */
+#define L_PROGRAM 0x4
+
 
 /* More informative names for the first two fields? */
 
@@ -71,7 +76,9 @@ typedef struct
 	 * expressed as a bitmask of GI string values. */
 	U8 gi;
 
-	/* TODO - flashlamps desired should also be defined here */
+	/** The flasher that it will want to control, or L_ALL_FLASHERS.
+	Only non-shared leffs can allocate flashers. */
+	U8 flashers;
 
 	/** The function implementing the leff */
 	leff_function_t fn;
@@ -121,6 +128,81 @@ extern inline void leff_create_peer (void (*fn)(void))
 	task_inherit_class_data (tp, leff_data_t);
 }
 
+/** The instructions in a leff program.  Each is one byte, followed
+ * by the operands given.  Programs are written with the LEFF_xxx
+ * macros below, rather than with these directly. */
+enum leff_opcode
+{
+	/** Exit the leff, as for leff_exit() */
+	LOP_END,
+	/** ticks : wait before the next instruction */
+	LOP_SLEEP,
+	/** lamp : change one lamp */
+	LOP_ON,
+	LOP_OFF,
+	LOP_TOGGLE,
+	/** op, lamplist : apply an operator to a whole lamplist at once */
+	LOP_APPLY,
+	/** op, lamplist, ticks : apply an operator to a lamplist, one lamp
+	(or one section, if it has breaks) at a time, waiting in between */
+	LOP_WALK,
+	/** fn, lamplist : call one of the lamplist step/build/rotate
+	functions on the leff's lamp matrix */
+	LOP_STEP,
+	/** gi : enable or disable GI strings */
+	LOP_GI_ON,
+	LOP_GI_OFF,
+	/** sol : pulse a flasher */
+	LOP_FLASH,
+	/** count : repeat the instructions up to the next LOP_NEXT, or
+	forever if the count is zero */
+	LOP_LOOP,
+	LOP_NEXT,
+};
+
+/** Operators for LOP_APPLY and LOP_WALK */
+#define LEFF_OP_ON 0
+#define LEFF_OP_OFF 1
+#define LEFF_OP_TOGGLE 2
+
+/** Functions for LOP_STEP */
+#define LEFF_STEP_STEP_UP 0
+#define LEFF_STEP_STEP_DOWN 1
+#define LEFF_STEP_BUILD_UP 2
+#define LEFF_STEP_BUILD_DOWN 3
+#define LEFF_STEP_ROTATE_UP 4
+#define LEFF_STEP_ROTATE_DOWN 5
+
+#define LEFF_END                  LOP_END
+#define LEFF_SLEEP(ticks)         LOP_SLEEP, (ticks)
+#define LEFF_ON(lamp)             LOP_ON, (lamp)
+#define LEFF_OFF(lamp)            LOP_OFF, (lamp)
+#define LEFF_TOGGLE(lamp)         LOP_TOGGLE, (lamp)
+#define LEFF_APPLY(set, op)       LOP_APPLY, LEFF_OP_##op, (set)
+#define LEFF_WALK(set, op, ticks) LOP_WALK, LEFF_OP_##op, (set), (ticks)
+#define LEFF_STEP(set, fn)        LOP_STEP, LEFF_STEP_##fn, (set)
+#define LEFF_GI_ON(gi)            LOP_GI_ON, (gi)
+#define LEFF_GI_OFF(gi)           LOP_GI_OFF, (gi)
+#define LEFF_FLASH(sol)           LOP_FLASH, (sol)
+#define LEFF_LOOP(count)          LOP_LOOP, (count)
+#define LEFF_FOREVER              LOP_LOOP, 0
+#define LEFF_NEXT                 LOP_NEXT
+
+#ifdef MACHINE_LEFF_PROGRAMS
+bool leff_program_can_start (U8 flags);
+void leff_program_start (leffnum_t dn, const U8 *program, U8 flags, U8 page);
+void leff_program_stop (leffnum_t dn);
+void leff_program_stop_exclusive (void);
+void leff_program_expire (U8 cond);
+void leff_program_stop_all (void);
+#else
+extern inline void leff_program_stop (leffnum_t dn) {}
+extern inline void leff_program_stop_exclusive (void) {}
+extern inline void leff_program_expire (U8 cond) {}
+extern inline void leff_program_stop_all (void) {}
+#endif
+void leff_finish (leffnum_t dn);
+
 void leff_start (leffnum_t dn);
 void leff_stop (leffnum_t dn);
 bool leff_running_p (leffnum_t dn);
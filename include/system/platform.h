@@ -7,6 +7,51 @@ extern __fastram__ switch_bits_t sw_edge;
 extern __fastram__ switch_bits_t sw_stable;
 extern __fastram__ switch_bits_t sw_unstable;
 extern __fastram__ switch_bits_t sw_logical;
+extern __fastram__ U8 sw_stable_cols[SWITCH_COLS_SIZE];
+
+/** Note that a switch column has stable switches, so that
+ * switch_periodic will visit it */
+extern inline void platform_switch_mark_stable (const U8 col)
+{
+	if (sw_stable[col])
+		sw_stable_cols[col / 8] |= single_bit_set (col % 8);
+}
+
+#ifdef CONFIG_SWITCH_LATENCY
+extern __fastram__ U16 sw_latency_clock;
+extern U16 sw_latency_edge_time[];
+
+/** Advance the switch latency clock.  This is called once per
+ * switch RTT. */
+extern inline void platform_switch_latency_tick (void)
+{
+	sw_latency_clock++;
+}
+
+/** Record the time at which switches in a column became stable.
+ * PREV is the column's stable bits before the latest update. */
+extern inline void platform_switch_latency_stamp (const U8 col, U8 prev)
+{
+	U8 rows = sw_stable[col] & ~prev;
+	U16 *stamp = &sw_latency_edge_time[col * 8];
+
+	while (rows)
+	{
+		if (rows & 1)
+			*stamp = sw_latency_clock;
+		stamp++;
+		rows >>= 1;
+	}
+}
+#else
+extern inline void platform_switch_latency_tick (void)
+{
+}
+
+extern inline void platform_switch_latency_stamp (const U8 col, U8 prev)
+{
+}
+#endif
 
 extern inline void platform_switch_input (const U8 col, U8 value)
 {
@@ -15,10 +60,13 @@ extern inline void platform_switch_input (const U8 col, U8 value)
 
 extern inline void platform_switch_debounce (const U8 col)
 {
+	U8 prev = sw_stable[col];
 	U8 edge = sw_raw[col] ^ sw_logical[col];
 	sw_stable[col] |= edge & sw_edge[col];
 	sw_unstable[col] |= ~edge & sw_stable[col];
 	sw_edge[col] = edge;
+	platform_switch_latency_stamp (col, prev);
+	platform_switch_mark_stable (col);
 }
 
 extern __fastram__ U8 lamp_matrix[NUM_LAMP_COLS];
@@ -28,9 +76,15 @@ extern __fastram__ U8 lamp_leff2_matrix[NUM_LAMP_COLS];
 extern __fastram__ U8 lamp_leff2_allocated[NUM_LAMP_COLS];
 extern __fastram__ U8 lamp_strobe_mask;
 extern __fastram__ U8 lamp_strobe_column;
+#ifdef CONFIG_LAMP_STROBE_SCHEDULE
+extern __fastram__ U8 lamp_strobe_slot;
+#endif
 extern __fastram__ U8 lamp_power_timer;
 extern U8 lamp_power_level;
 extern U16 lamp_power_idle_timer;
+#ifdef CONFIG_LAMP_FADE
+extern __fastram__ const U8 *lamp_fade_plane_now;
+#endif
 
 extern inline U8 platform_lamp_compute (const U8 col)
 {
@@ -47,11 +101,12 @@ extern inline U8 platform_lamp_compute (const U8 col)
 	 */
 	bits |= lamp_flash_matrix_now[col];
 
-	/* TODO : implement lamp strobing, like the newer Stern games
-	do.  Implement like DMD page flipping, alternating between 2
-	different lamp matrices rapidly to present 4 different
-	intensities.  A background task, like the flash_rtt above,
-	would toggle the intensities at a slower rate. */
+#ifdef CONFIG_LAMP_FADE
+	/* OR in the brightness plane being shown during this scan.
+	Like DMD page flipping, lamp_fade_next_plane() switches between
+	the planes to present the different intensities. */
+	bits |= lamp_fade_plane_now[col];
+#endif
 
 	/* Override with the lamp effect lamps.
 	 * Leff2 bits are low priority and used for long-running
@@ -67,5 +122,6 @@ extern inline U8 platform_lamp_compute (const U8 col)
 }
 
 extern __fastram__ U8 sol_duty_mask;
+extern __fastram__ U8 sol_flash_budget;
 
 #endif /* __SYS_PLATFORM_H */
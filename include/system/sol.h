@@ -58,6 +58,13 @@ the more powerful the pulse. */
 #define FLASHER_TIME_DEFAULT 24
 #define FLASHER_DUTY_DEFAULT SOL_DUTY_100
 
+/** The most flashers that can be energized at once.  Flashers beyond
+ * this wait for a later duty cycle slot, so that overlapping effects
+ * do not overload the flasher supply.  A machine can override it. */
+#ifndef MACHINE_FLASHER_BUDGET
+#define MACHINE_FLASHER_BUDGET 4
+#endif
+
 /* Function prototypes */
 void sol_req_start_specific (U8 sol, U8 mask, U8 time);
 void sol_request_async (U8 sol);
@@ -65,6 +72,9 @@ void sol_request (U8 sol);
 void sol_start_real (solnum_t sol, U8 cycle_mask, U8 ticks);
 void sol_stop (solnum_t sol);
 void sol_init (void);
+void flasher_leff_allocate (solnum_t sol);
+void flasher_leff_allocate_all (void);
+void flasher_leff_free_all (void);
 
 /* sol_start is a wrapper function, because the 'time' value must be scaled
 to the correct resolution.  Ticks are normally 1 per 16ms, but
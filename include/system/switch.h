@@ -101,6 +101,9 @@ depending on the system type. */
 
 #define SWITCH_BITS_SIZE	(NUM_SWITCHES / 8)
 
+/** The size of a bitmap with one bit per switch column */
+#define SWITCH_COLS_SIZE	((SWITCH_BITS_SIZE + 7) / 8)
+
 #define SW_COL(x)			((x) >> 3)
 #define SW_ROW(x)			((x) & 0x07)
 #define SW_ROWMASK(x)	single_bit_set (SW_ROW(x))
@@ -243,6 +246,58 @@ const switch_info_t *switch_lookup (const switchnum_t sw) __pure__;
 U8 switch_lookup_lamp (const switchnum_t sw) __pure__;
 void switch_queue_dump (void);
 
+#ifdef CONFIG_SWITCH_LATENCY
+/** The number of histogram buckets kept for each switch */
+#define SW_LATENCY_BUCKETS 6
+
+/** The resolution of the latency clock, which is advanced by
+ * the switch RTT */
+#define SW_LATENCY_MS_PER_TICK 2
+
+/** Latency statistics for a single switch.  All times are in
+ * latency clock ticks. */
+struct switch_latency
+{
+	/** The number of handler invocations measured */
+	U16 count;
+
+	/** The sum of all total latencies, used for the average */
+	U16 sum;
+
+	/** The best and worst total latencies */
+	U8 min;
+	U8 max;
+
+	/** The worst time from becoming stable to being scheduled */
+	U8 queue_max;
+
+	/** The worst time from being scheduled to the handler running */
+	U8 task_max;
+
+	/** A histogram of total latencies, in powers of 2 */
+	U8 buckets[SW_LATENCY_BUCKETS];
+};
+
+/** The times carried by each switch handler task, from when it is
+ * scheduled until it runs */
+struct switch_latency_stamp
+{
+	/** The value of the latency clock when the task was started */
+	U16 sched_time;
+
+	/** The time from becoming stable to being scheduled */
+	U8 queue_ticks;
+};
+
+extern struct switch_latency sw_latency_stats[];
+
+void switch_latency_dispatch (task_pid_t tp, const U8 sw);
+void switch_latency_handler (const U8 sw);
+U8 switch_latency_average (const U8 sw);
+void switch_latency_reset (void);
+void switch_latency_dump (void);
+#endif
+
 #if (MACHINE_PIC == 1)
 __init__ void pic_init (void);
 __init__ void pic_render_serial_number (void);
@@ -44,6 +44,8 @@ typedef pth_t task_pid_t;
 #include <pthread.h>
 #define __noreturn__ __attribute__((noreturn))
 typedef pthread_t task_pid_t;
+#elif defined(CONFIG_UCONTEXT)
+typedef struct ucontext_task *task_pid_t;
 #else
 typedef int task_pid_t;
 #endif
@@ -228,6 +230,7 @@ void task_sleep_periodic (void);
 __noreturn__ void task_exit (void);
 task_pid_t task_find_gid (task_gid_t);
 task_pid_t task_find_gid_next (task_pid_t first, task_gid_t gid);
+task_gid_t task_pid_gid (task_pid_t tp);
 void task_kill_pid (task_pid_t tp);
 bool task_kill_gid (task_gid_t);
 void task_kill_all (void);
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Event handler profiling.
+ *
+ * With CONFIG_CALLSET_PROFILE, gencallset times every call that an event
+ * makes to a CALLSET_ENTRY, and charges it to that pair of event and
+ * module by calling callset_profile_end().  Nested events are included
+ * in the time of the handler that threw them, and so is any time that a
+ * handler spends asleep.
+ *
+ * The pairs which took the most time overall can be viewed from the
+ * development menu in test mode, or dumped to the debugger with
+ * callset_profile_dump().
+ */
+
+#include <freewpc.h>
+#include <printf.h>
+
+#ifndef CONFIG_NATIVE
+/** The profile clock, which counts IRQs */
+__fastram__ U16 callset_profile_irqs;
+#endif
+
+/** The measurements for each profiled call */
+struct callset_profile callset_profile_table[CALLSET_PROFILE_SLOTS];
+
+
+/** Limit a time to what can be printed */
+static U16 callset_profile_u16 (U32 time)
+{
+	return (time > 0xFFFF) ? 0xFFFF : time;
+}
+
+
+/** Called after each profiled call, with the clock reading from just
+ * before it. */
+void callset_profile_end (U16 slot, callset_profile_time_t start)
+{
+	struct callset_profile *prof = &callset_profile_table[slot];
+	callset_profile_time_t len = callset_profile_clock () - start;
+
+	if (len > prof->worst)
+		prof->worst = len;
+
+	/* Keep the total from overflowing by halving it along with the count;
+	the average is unchanged. */
+	if (prof->count == 0xFFFF)
+	{
+		prof->count /= 2;
+		prof->total /= 2;
+	}
+	prof->count++;
+	prof->total += len;
+}
+
+
+/** Return the average time taken by a profiled call */
+callset_profile_time_t callset_profile_average (U16 slot)
+{
+	const struct callset_profile *prof = &callset_profile_table[slot];
+	if (prof->count == 0)
+		return 0;
+	return prof->total / prof->count;
+}
+
+
+/** Fill ORDER with the slots that have taken the most total time, most
+ * first, up to MAX of them.  Slots that were never called are left out.
+ * Returns the number of slots filled in. */
+U8 callset_profile_rank (U16 *order, U8 max)
+{
+	U16 slot;
+	U8 n = 0;
+	U8 i;
+
+	for (slot = 0; slot < CALLSET_PROFILE_SLOTS; slot++)
+	{
+		U32 total = callset_profile_table[slot].total;
+		if (callset_profile_table[slot].count == 0)
+			continue;
+
+		/* Find where this slot goes, and shift the slower ones down */
+		for (i = n; i > 0; i--)
+		{
+			if (callset_profile_table[order[i-1]].total >= total)
+				break;
+			if (i < max)
+				order[i] = order[i-1];
+		}
+		if (i < max)
+		{
+			order[i] = slot;
+			if (n < max)
+				n++;
+		}
+	}
+	return n;
+}
+
+
+/** Clear all of the profile measurements */
+void callset_profile_reset (void)
+{
+	memset (callset_profile_table, 0, sizeof (callset_profile_table));
+}
+
+
+#ifdef DEBUGGER
+void callset_profile_dump (void)
+{
+	U16 order[CALLSET_PROFILE_TOP];
+	U8 n, count;
+
+	count = callset_profile_rank (order, CALLSET_PROFILE_TOP);
+	dbprintf ("Event module: N avg worst (%s) total (ms)\n",
+		CALLSET_PROFILE_UNITS);
+	for (n = 0; n < count; n++)
+	{
+		const struct callset_profile *prof = &callset_profile_table[order[n]];
+
+		callset_profile_name (order[n]);
+		dbprintf1 ();
+		dbprintf (": %ld %ld %ld %ld\n", prof->count,
+			callset_profile_u16 (callset_profile_average (order[n])),
+			callset_profile_u16 (prof->worst),
+			callset_profile_u16 (prof->total / CALLSET_PROFILE_UNITS_PER_MS));
+		task_runs_long ();
+	}
+}
+#endif /* DEBUGGER */
+
+
+CALLSET_ENTRY (callsetprof, init)
+{
+	callset_profile_reset ();
+}
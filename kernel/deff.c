@@ -73,22 +73,45 @@ U8 deff_data_pending_count;
 U8 deff_data_active[MAX_DEFF_DATA];
 U8 deff_data_active_count;
 
+/** The maximum number of deffs that can wait for the display */
 #define MAX_QUEUED_DEFFS 8
 
 struct deff_queue_entry
 {
 	U8 id;
+	U8 prio;
 	U16 timeout;
 };
 
+/** The deffs waiting for the display, in priority order: the one that
+should run next is always first.  Entries of equal priority are kept in
+the order that they were queued. */
 struct deff_queue_entry deff_queue[MAX_QUEUED_DEFFS];
 
+/** The number of entries in use in deff_queue */
+U8 deff_queue_count;
+
+/** A bit for each deff, set while it is in the queue */
+U8 deff_queued_bits[BITS_TO_BYTES (MAX_DEFFS)];
+
+/** The earliest timeout of anything in the queue.  Until then, there is
+no need to look for expired entries. */
+U16 deff_queue_deadline;
+
 
 void dump_deffs (void)
 {
+	U8 n;
+
 	dbprintf ("Background: %d\n", deff_background);
 	dbprintf ("Running: %d\n", deff_running);
 	dbprintf ("Priority: %d\n", deff_prio);
+	for (n = 0; n < deff_queue_count; n++)
+	{
+		dbprintf ("Queued: %d prio %d, %ld left\n",
+			deff_queue[n].id, deff_queue[n].prio,
+			(U16)(deff_queue[n].timeout - get_sys_time ()));
+	}
 }
 
 
@@ -158,30 +181,64 @@ static void deff_start_task (const deff_t *deff)
  */
 void deff_queue_reset (void)
 {
-	struct deff_queue_entry *dq = deff_queue;
-	do
+	deff_queue_count = 0;
+	memset (deff_queued_bits, 0, sizeof (deff_queued_bits));
+}
+
+
+/**
+ * Return nonzero if a display effect is in the queue.
+ */
+static bool deff_queued_p (U8 id)
+{
+	return bitarray_test (deff_queued_bits, id);
+}
+
+
+/**
+ * Remove the queue entry at position N.  The entries after it
+ * move up to keep the queue in order.
+ */
+static void deff_queue_remove (U8 n)
+{
+	bitarray_clear (deff_queued_bits, deff_queue[n].id);
+	deff_queue_count--;
+	while (n < deff_queue_count)
 	{
-		dq->id = DEFF_NULL;
-		dq->timeout = 0;
-	} while (++dq < deff_queue + MAX_QUEUED_DEFFS);
+		deff_queue[n] = deff_queue[n+1];
+		n++;
+	}
 }
 
 
 /**
- * Find a display queue entry with the given id.
+ * Drop any queued effects which have waited too long.
  *
- * This can be an actual deff number, or DEFF_NULL if you want to
- * find a free entry.
+ * This only scans the queue once the earliest deadline has been
+ * reached; the scan then finds the next one.
  */
-struct deff_queue_entry *deff_queue_find (U8 id)
+static void deff_queue_expire (void)
 {
-	struct deff_queue_entry *dq = deff_queue;
-	do
+	U8 n;
+	U16 now;
+
+	if (deff_queue_count == 0 || !time_reached_p (deff_queue_deadline))
+		return;
+
+	n = 0;
+	while (n < deff_queue_count)
 	{
-		if (dq->id == id)
-			return dq;
-	} while (++dq < deff_queue + MAX_QUEUED_DEFFS);
-	return NULL;
+		if (time_reached_p (deff_queue[n].timeout))
+			deff_queue_remove (n);
+		else
+			n++;
+	}
+
+	now = get_sys_time ();
+	deff_queue_deadline = now + 0x7FFF;
+	for (n = 0; n < deff_queue_count; n++)
+		if ((U16)(deff_queue[n].timeout - now) < (U16)(deff_queue_deadline - now))
+			deff_queue_deadline = deff_queue[n].timeout;
 }
 
 
@@ -190,34 +247,10 @@ struct deff_queue_entry *deff_queue_find (U8 id)
  */
 struct deff_queue_entry *deff_queue_find_priority (void)
 {
-	struct deff_queue_entry *dq = deff_queue;
-	struct deff_queue_entry *answer = NULL;
-	U8 highest_prio = PRI_NULL;
-
-	do
-	{
-		if (dq->id != DEFF_NULL)
-		{
-			const deff_t *deff;
-
-			if (time_reached_p (dq->timeout))
-			{
-				/* This queued effect already expired, so we will
-				ignore it and free it. */
-				dq->id = dq->timeout = 0;
-			}
-			else
-			{
-				deff = &deff_table[dq->id];
-				if (deff->prio > highest_prio)
-				{
-					answer = dq;
-					highest_prio = deff->prio;
-				}
-			}
-		}
-	} while (++dq < deff_queue + MAX_QUEUED_DEFFS);
-	return answer;
+	deff_queue_expire ();
+	if (deff_queue_count == 0)
+		return NULL;
+	return &deff_queue[0];
 }
 
 
@@ -226,22 +259,36 @@ struct deff_queue_entry *deff_queue_find_priority (void)
  */
 void deff_queue_add (U8 id, U16 timeout)
 {
-	struct deff_queue_entry *dq;
+	U8 prio = deff_table[id].prio;
+	U8 n;
 
 	/* Ensure that no entry is added to the queue twice.
 	If it's already in there, just return. */
-	dq = deff_queue_find (id);
-	if (dq)
+	if (deff_queued_p (id))
+		return;
+
+	/* If the queue is full, then the effect just won't ever happen. */
+	deff_queue_expire ();
+	if (deff_queue_count == MAX_QUEUED_DEFFS)
 		return;
 
-	/* Find and initialize a free entry.  If the queue is full, then
-	the effect just won't ever happen. */
-	dq = deff_queue_find (DEFF_NULL);
-	if (dq)
+	/* Insert the entry after everything of the same or higher priority. */
+	n = deff_queue_count;
+	while (n > 0 && deff_queue[n-1].prio < prio)
 	{
-		dq->id = id;
-		dq->timeout = get_sys_time() + timeout;
+		deff_queue[n] = deff_queue[n-1];
+		n--;
 	}
+
+	timeout += get_sys_time ();
+	deff_queue[n].id = id;
+	deff_queue[n].prio = prio;
+	deff_queue[n].timeout = timeout;
+	bitarray_set (deff_queued_bits, id);
+
+	if (deff_queue_count == 0 || ((U16)(timeout - deff_queue_deadline) & 0x8000))
+		deff_queue_deadline = timeout;
+	deff_queue_count++;
 }
 
 
@@ -250,12 +297,16 @@ void deff_queue_add (U8 id, U16 timeout)
  */
 void deff_queue_delete (U8 id)
 {
-	struct deff_queue_entry *dq = deff_queue_find (id);
-	if (dq)
-	{
-		dq->id = 0;
-		dq->timeout = 0;
-	}
+	U8 n;
+
+	if (!deff_queued_p (id))
+		return;
+	for (n = 0; n < deff_queue_count; n++)
+		if (deff_queue[n].id == id)
+		{
+			deff_queue_remove (n);
+			return;
+		}
 }
 
 
@@ -272,17 +323,13 @@ void deff_queue_service (void)
 	If there is such, start it if its priority exceeds that
 	of the currently display effect. */
 	struct deff_queue_entry *dq = deff_queue_find_priority ();
-	if (dq)
+	if (dq && deff_prio < dq->prio)
 	{
-		const deff_t *deff = &deff_table[dq->id];
-		if (deff_prio < deff->prio)
-		{
-			dbprintf ("deff_queue_service starting %d\n", dq->id);
-			deff_running = dq->id;
-			dq->id = dq->timeout = 0;
-			deff_start_task (deff);
-			return;
-		}
+		dbprintf ("deff_queue_service starting %d\n", dq->id);
+		deff_running = dq->id;
+		deff_queue_remove (0);
+		deff_start_task (&deff_table[deff_running]);
+		return;
 	}
 
 	/* Delay updating background effect briefly, to allow
@@ -316,7 +363,7 @@ void deff_start (deffnum_t id)
 	}
 
 	/* Nothing to do if it's already queued */
-	if (deff_queue_find (id))
+	if (deff_queued_p (id))
 		return;
 
 	/* This effect can take the display now if it has priority.
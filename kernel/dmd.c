@@ -106,16 +106,6 @@ dmd_transition_t *dmd_transition;
 __fastram__ void (*dmd_rtt) (void);
 
 
-/** The trans data pointer provides transition functions with
- * state.  The pointer is initialized to NULL before the
- * first call to the transition functions; they can use it
- * however they wish.  Typically, it would be used to
- * save a pointer into the DMD buffer, indicating what should
- * be updated on the next cycle of the transition.
- */
-U8 *dmd_trans_data_ptr;
-U8 *dmd_trans_data_ptr2;
-
 /** The page number of the composite page, used during
  * transitions.  Each frame of the transition sequence
  * is stored here.  If the frame is 4-color, then two
@@ -124,6 +114,12 @@ U8 *dmd_trans_data_ptr2;
  */
 U8 dmd_composite_page;
 
+#ifdef CONFIG_DMD_DIRTY_ROWS
+/** For each DMD page, the range of rows that may be nonblank.
+ * Cleaning and copying a page only touches these rows. */
+struct dmd_dirty_rows dmd_dirty[PINIO_NUM_DMD_PAGES];
+#endif
+
 /* Forward declarations of the 3 phases of the DMD FIRQ functions */
 void dmd_rtt0 (void);
 void dmd_rtt1 (void);
@@ -162,6 +158,14 @@ void dmd_init (void)
 #if PINIO_DMD_PIXEL_BITS == 8
 	dmd_current_color = 1;
 #endif
+#ifdef CONFIG_DMD_DIRTY_ROWS
+	{
+		/* Nothing is known about the page contents at powerup */
+		dmd_pagenum_t page;
+		for (page = 0; page < PINIO_NUM_DMD_PAGES; page++)
+			dmd_dirty_all (page);
+	}
+#endif
 
 	/* If DMD_BLANK_PAGE_COUNT is defined, this says how
 	 * many DMD pages should not be allocatable, but should be
@@ -402,15 +406,34 @@ void dmd_fill_page_low (void)
 }
 
 
+/**
+ * Clean a mapped page, given its page number and window address.
+ * With dirty row tracking, only the rows that may have been drawn
+ * since the last clean are cleared.
+ */
+static void dmd_clean_mapped (dmd_pagenum_t page, dmd_buffer_t dbuf)
+{
+#ifdef CONFIG_DMD_DIRTY_ROWS
+	struct dmd_dirty_rows *dirty = &dmd_dirty[page];
+	if (dirty->first <= dirty->last)
+		__blockclear16 (dbuf + dirty->first * DMD_BYTE_WIDTH,
+			(U16)(dirty->last - dirty->first + 1) * DMD_BYTE_WIDTH);
+	dmd_dirty_clear (page);
+#else
+	dmd_clean_page (dbuf);
+#endif
+}
+
+
 void dmd_clean_page_low (void)
 {
-	dmd_clean_page (dmd_low_buffer);
+	dmd_clean_mapped (dmd_low_page, dmd_low_window);
 }
 
 
 void dmd_clean_page_high (void)
 {
-	dmd_clean_page (dmd_high_buffer);
+	dmd_clean_mapped (dmd_high_page, dmd_high_window);
 }
 
 
@@ -444,50 +467,47 @@ void dmd_copy_page (dmd_buffer_t dst, const dmd_buffer_t src)
 }
 
 
+/**
+ * Copy the low mapped page to the high mapped page.
+ * With dirty row tracking, only rows that are dirty in either page
+ * are copied; the rest are blank in both already.
+ */
 void dmd_copy_low_to_high (void)
 {
+#ifdef CONFIG_DMD_DIRTY_ROWS
+	struct dmd_dirty_rows *src = &dmd_dirty[dmd_low_page];
+	struct dmd_dirty_rows *dst = &dmd_dirty[dmd_high_page];
+	U8 first = src->first;
+	U8 last = src->last;
+
+	if (dst->first < first)
+		first = dst->first;
+	if (dst->last > last)
+		last = dst->last;
+
+	if (first <= last)
+		__blockcopy16 (dmd_high_window + first * DMD_BYTE_WIDTH,
+			dmd_low_window + first * DMD_BYTE_WIDTH,
+			(U16)(last - first + 1) * DMD_BYTE_WIDTH);
+	*dst = *src;
+#else
 	dmd_copy_page (dmd_high_buffer, dmd_low_buffer);
+#endif
 }
 
 
 void dmd_alloc_low_clean (void)
 {
 	dmd_alloc_low ();
-	dmd_clean_page (dmd_low_buffer);
+	dmd_clean_page_low ();
 }
 
 
 void dmd_alloc_pair_clean (void)
 {
 	dmd_alloc_pair ();
-	dmd_clean_page (dmd_low_buffer);
-	dmd_clean_page (dmd_high_buffer);
-}
-
-
-/*
- * Helper function used to do a DMD transition.
- * This contains common logic that needs to happen several times during
- * a transition.
- */
-static inline void dmd_do_transition_cycle (U8 old_page, U8 new_page)
-{
-	/* On entry, the composite buffer must be mapped into the
-	 * high page. */
-
-	/* Map the old image in low memory. */
-	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, old_page);
-
-	/* Initialize the composite from the old image. */
-	dmd_transition->composite_old ();
-
-	/* Now remap the new image into low memory */
-	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, new_page);
-
-	/* Update the composite using the new image data.
-	 * This function should set dmd_in_transition to FALSE when
-	 * the transition is done. */
-	dmd_transition->composite_new ();
+	dmd_clean_page_low ();
+	dmd_clean_page_high ();
 }
 
 
@@ -497,10 +517,17 @@ static inline void dmd_do_transition_cycle (U8 old_page, U8 new_page)
  * Transitions are complicated because the old/new images may have
  * different color depths (mono or 4-color).  Also, we can only map
  * two pages at a time, but there may be up to 4 different pages
- * involved.
+ * involved.  So each frame is drawn one plane at a time: the dark
+ * plane from the old and new dark pages, then the bright plane from
+ * the bright pages, with the same list of operations.
  *
- * First, we check to see if both old and new images are mono.  If so,
- * then the transition can be optimized slightly.
+ * Each frame is drawn into a composite pair that is not being shown,
+ * so that a refresh never sees the new dark plane with the old bright
+ * one.  Most transitions allocate a new pair for every frame.  A
+ * DMD_TRANS_IN_PLACE transition only adds to the previous frame, so it
+ * alternates between two pairs.  The pair being drawn is then two frames
+ * behind, and the previous frame's operations are drawn again to catch
+ * it up.
  *
  * For debugging transitions, define STEP_TRANSITION.  The transition
  * will take place one frame at a time; use the launch button to
@@ -510,18 +537,19 @@ void dmd_do_transition (void)
 {
 	const U8 new_dark_page = dmd_low_page;
 	const U8 new_bright_page = dmd_high_page;
-
-	dmd_trans_data_ptr = NULL;
-	dmd_trans_data_ptr2 = NULL;
+	const struct dmd_trans_op *ops;
+	const struct dmd_trans_op *next_ops;
+	const struct dmd_trans_op *redo_ops;
+	U8 composite[2];
+	U8 count;
+	U8 frame;
 
 	page_push (TRANS_PAGE);
 
-	if (dmd_transition->composite_init)
-	{
-		(*dmd_transition->composite_init) ();
-		dmd_trans_data_ptr2 = dmd_trans_data_ptr;
-	}
-
+	ops = dmd_transition->ops;
+	redo_ops = NULL;
+	count = dmd_transition->count;
+	frame = 0;
 	while (dmd_in_transition)
 	{
 #if defined(STEP_TRANSITION) && defined(MACHINE_LAUNCH_SWITCH)
@@ -534,34 +562,52 @@ void dmd_do_transition (void)
 		task_sleep (dmd_transition->delay);
 #endif
 
-		do {
-			dmd_composite_page = dmd_alloc ();
-		} while ((dmd_composite_page == (new_dark_page & ~1)) ||
-			(dmd_composite_page == (new_bright_page & ~1)));
+		/* Allocate a new composite pair for the frame, except that an
+		 * in-place transition reuses the two pairs of its first frames. */
+		if (frame < 2 || !(dmd_transition->flags & DMD_TRANS_IN_PLACE))
+		{
+			do {
+				dmd_composite_page = dmd_alloc ();
+			} while ((dmd_composite_page == (new_dark_page & ~1)) ||
+				(dmd_composite_page == (new_bright_page & ~1)) ||
+				(frame == 1 && dmd_composite_page == composite[0]));
+
+			dmd_dirty_all (dmd_composite_page);
+			dmd_dirty_all (dmd_composite_page+1);
+			if (frame < 2)
+				composite[frame] = dmd_composite_page;
+		}
+		else
+		{
+			dmd_composite_page = composite[frame & 1];
+		}
 
 		/* Handle the transition of the dark page first.
-		 * Use the lower composite pair page. */
+		 * Use the lower composite pair page.  The old image is the
+		 * frame being shown now. */
 		pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dmd_composite_page);
-		dmd_do_transition_cycle (dmd_dark_page, new_dark_page);
+		if (redo_ops)
+			dmd_trans_draw (redo_ops, dmd_dark_page, new_dark_page);
+		next_ops = dmd_trans_draw (ops, dmd_dark_page, new_dark_page);
 
 		/* Handle the transition of the bright page.
 		 * Use the upper composite pair page (+1). */
-		{
-			U8 *tmp_trans_data_ptr;
-
-			tmp_trans_data_ptr = dmd_trans_data_ptr;
-			dmd_trans_data_ptr = dmd_trans_data_ptr2;
+		pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dmd_composite_page+1);
+		if (redo_ops)
+			dmd_trans_draw (redo_ops, dmd_bright_page, new_bright_page);
+		dmd_trans_draw (ops, dmd_bright_page, new_bright_page);
 
-			pinio_dmd_window_set (PINIO_DMD_WINDOW_1, dmd_composite_page+1);
-			dmd_do_transition_cycle (dmd_bright_page, new_bright_page);
-
-			dmd_trans_data_ptr2 = dmd_trans_data_ptr;
-			dmd_trans_data_ptr = tmp_trans_data_ptr;
-		}
+		if (dmd_transition->flags & DMD_TRANS_IN_PLACE)
+			redo_ops = ops;
+		ops = next_ops;
+		frame++;
 
 		/* Make the composite pages visible */
 		dmd_dark_page = dmd_composite_page;
 		dmd_bright_page = dmd_composite_page+1;
+
+		if (--count == 0)
+			dmd_in_transition = FALSE;
 	}
 
 	page_pop ();
@@ -70,6 +70,36 @@ __fastram__ U8 *blit_dmd;
 __fastram__ const U8 *bitmap_src;
 #endif
 
+#ifdef CONFIG_FONT_CACHE
+
+/** A string that has already been rendered.  The data holds
+ * the glyphs as they would be drawn at an X coordinate with the
+ * same low 3 bits, so it can be merged into the display a byte
+ * at a time without any shifting. */
+struct font_cache_entry
+{
+	const font_t *font;
+	U8 shift;
+	U8 byte_width;
+	U8 height;
+	char string[FONT_CACHE_STRING_LEN+1];
+	U8 data[FONT_CACHE_DATA_SIZE];
+};
+
+struct font_cache_entry font_cache[FONT_CACHE_ENTRIES];
+
+/** The entry to be replaced next */
+U8 font_cache_next;
+
+/** Hashes of strings that missed the cache recently.  A string is
+ * only cached when it is seen a second time, so that text drawn
+ * just once does not push out the strings that are redrawn often,
+ * like scores. */
+U16 font_cache_seen[FONT_CACHE_ENTRIES];
+U8 font_cache_seen_next;
+
+#endif /* CONFIG_FONT_CACHE */
+
 
 /* Returns a pointer to the glyph data for a character 'c'
  * in the font 'font'.  This points directly to the raw bytes
@@ -230,7 +260,7 @@ static void fontargs_render_string (void)
 	void (*blitter) (U8 *);
 #endif
 
-	dmd_base = ((U8 *)dmd_low_buffer) + args->coord.y * DMD_BYTE_WIDTH;
+	dmd_base = ((U8 *)dmd_low_window) + args->coord.y * DMD_BYTE_WIDTH;
 	s = sprintf_buffer;
 #if defined(CONFIG_UI_CONSOLE) || defined(CONFIG_UI_REMOTE)
 	ui_console_render_string (s);
@@ -239,6 +269,7 @@ static void fontargs_render_string (void)
 	/* Font data is stored in a separate page of ROM; switch
 	 * there to be able to read the font data */
 	page_push (FONT_PAGE);
+	dmd_dirty_mark (dmd_low_page, args->coord.y, args->font->height);
 
 	top_space = 0;
 
@@ -256,6 +287,11 @@ static void fontargs_render_string (void)
 		font_byte_width = (font_width + 7) >> 3;
 #endif
 
+		/* The rows covered by the string were marked dirty above,
+		but a glyph may be taller than its font. */
+		if (unlikely (font_height > args->font->height))
+			dmd_dirty_mark (dmd_low_page, args->coord.y, font_height);
+
 		/* If the height of this glyph is not the same as the
 		height of the overall string, then the character should
 		be bottom aligned.  This is needed for commas and periods.
@@ -309,7 +345,7 @@ bit-height, and the remaining bytes are the image data, going
 from top to bottom and then left to right. */
 void bitmap_blit (const U8 *src, U8 x, U8 y)
 {
-	U8 *dmd_base = ((U8 *)dmd_low_buffer) + y * DMD_BYTE_WIDTH;
+	U8 *dmd_base = ((U8 *)dmd_low_window) + y * DMD_BYTE_WIDTH;
 #ifndef __m6809__
 	void (*blitter) (U8 *);
 	U8 i, j;
@@ -320,6 +356,7 @@ void bitmap_blit (const U8 *src, U8 x, U8 y)
 	font_byte_width = (font_width + 7) >> 3;
 #endif
 	font_height = *src++;
+	dmd_dirty_mark (dmd_low_page, y, font_height);
 	blit_dmd = wpc_dmd_addr_verify (dmd_base + (x / 8));
 	bitmap_src = src;
 
@@ -353,6 +390,163 @@ void bitmap_blit2 (const U8 *src, U8 x, U8 y)
 }
 
 
+#ifdef CONFIG_FONT_CACHE
+
+/* Merge glyph data into the display the same way that the glyph
+ * blitters do. */
+#ifdef __m6809__
+#define font_cache_merge(dst, bits) dst |= (bits)
+#else
+#define font_cache_merge(dst, bits) dst ^= (bits)
+#endif
+
+
+/** Fill in a cache entry for the string in sprintf_buffer.
+ * Returns FALSE if it is too large to be cached. */
+static bool font_cache_fill (struct font_cache_entry *entry)
+{
+	const font_t *font = font_args.font;
+	const char *s;
+	const U8 *src;
+	U8 *dst;
+	U16 x;
+	U8 row, top, b, bits;
+	U8 byte_width, height;
+	bool fits;
+	char c;
+
+	page_push (FONT_PAGE);
+
+	/* Find the size of the bitmap, which is the size of the string
+	plus any padding in the glyph data, which is also drawn */
+	x = entry->shift;
+	byte_width = 0;
+	height = font->height;
+	for (s = sprintf_buffer; (c = *s) != '\0'; s++)
+	{
+		(void)font_lookup (font, c);
+		b = (x + ((font_width + 7) & ~7) + 7) / 8;
+		if (b > byte_width)
+			byte_width = b;
+		if (font_height > height)
+			height = font_height;
+		x += font_width + 1;
+	}
+
+	fits = (byte_width <= DMD_BYTE_WIDTH
+		&& (U16)byte_width * height <= FONT_CACHE_DATA_SIZE);
+	if (fits)
+	{
+		entry->byte_width = byte_width;
+		entry->height = height;
+		memset (entry->data, 0, (U16)byte_width * height);
+
+		/* Draw each glyph into the bitmap */
+		x = entry->shift;
+		for (s = sprintf_buffer; (c = *s) != '\0'; s++)
+		{
+			src = font_lookup (font, c);
+			if (src != font_space)
+			{
+				/* Short glyphs are bottom aligned, as in fontargs_render_string */
+				top = (font_height < font->height) ? font->height - font_height : 0;
+				for (row = 0; row < font_height; row++)
+				{
+					dst = entry->data + (top + row) * byte_width + (x / 8);
+					for (b = 0; b < ((font_width + 7) >> 3); b++)
+					{
+						bits = *src++;
+						font_cache_merge (dst[b], bits << (x & 7));
+						if (x & 7)
+							font_cache_merge (dst[b+1], bits >> (8 - (x & 7)));
+					}
+				}
+			}
+			x += font_width + 1;
+		}
+	}
+
+	page_pop ();
+	return fits;
+}
+
+
+/** Draw the string in sprintf_buffer from the cache, at the
+ * location in font_args.  The string is added to the cache if
+ * it has been drawn recently.  Returns FALSE if the string must be
+ * drawn normally. */
+static bool font_cache_render (void)
+{
+	struct font_cache_entry *entry;
+	const U8 *src;
+	U8 *dst;
+	U8 row, b;
+	U16 hash;
+	const char *s;
+
+	if (strlen (sprintf_buffer) > FONT_CACHE_STRING_LEN)
+		return FALSE;
+
+	for (entry = font_cache; entry < font_cache + FONT_CACHE_ENTRIES; entry++)
+		if (entry->font == font_args.font
+			&& entry->shift == (font_args.coord.x & 7)
+			&& !strcmp (entry->string, sprintf_buffer))
+			goto hit;
+
+	hash = font_args.coord.x & 7;
+	for (s = sprintf_buffer; *s; s++)
+		hash = (hash << 1) + (hash >> 15) + *s;
+	for (b = 0; b < FONT_CACHE_ENTRIES; b++)
+		if (font_cache_seen[b] == hash)
+			break;
+	if (b == FONT_CACHE_ENTRIES)
+	{
+		font_cache_seen[font_cache_seen_next] = hash;
+		font_cache_seen_next = (font_cache_seen_next + 1) % FONT_CACHE_ENTRIES;
+		return FALSE;
+	}
+
+	entry = font_cache + font_cache_next;
+	entry->font = NULL;
+	entry->shift = font_args.coord.x & 7;
+	if (!font_cache_fill (entry))
+		return FALSE;
+	entry->font = font_args.font;
+	strcpy (entry->string, sprintf_buffer);
+	font_cache_next = (font_cache_next + 1) % FONT_CACHE_ENTRIES;
+
+hit:
+#if defined(CONFIG_UI_CONSOLE) || defined(CONFIG_UI_REMOTE)
+	ui_console_render_string (sprintf_buffer);
+#endif
+	dmd_dirty_mark (dmd_low_page, font_args.coord.y, entry->height);
+	dst = wpc_dmd_addr_verify (dmd_low_window
+		+ font_args.coord.y * DMD_BYTE_WIDTH + font_args.coord.x / 8);
+	src = entry->data;
+	for (row = entry->height; row > 0; row--)
+	{
+		for (b = 0; b < entry->byte_width; b++)
+			font_cache_merge (dst[b], src[b]);
+		src += entry->byte_width;
+		dst += DMD_BYTE_WIDTH;
+	}
+	return TRUE;
+}
+
+
+/** Render a string whose area has been computed, from the cache
+ * if possible. */
+static void fontargs_render_string_cached (void)
+{
+	if (!font_cache_render ())
+		fontargs_render_string ();
+}
+
+#else
+#define fontargs_render_string_cached fontargs_render_string
+#endif /* CONFIG_FONT_CACHE */
+
+
 /** Calculate font_string_width and font_string_height
  * in advance for a particular string to be rendered in a
  * particular font.  This is needed when doing centered or
@@ -405,7 +599,7 @@ static void font_get_string_area (const char *s)
 void fontargs_render_string_left (const char *s)
 {
 	font_get_string_area (s);
-	fontargs_render_string ();
+	fontargs_render_string_cached ();
 }
 
 
@@ -414,7 +608,7 @@ void fontargs_render_string_center (const char *s)
 	font_get_string_area (s);
 	font_args.coord.x = font_args.coord.x - (font_string_width / 2);
 	font_args.coord.y = font_args.coord.y - (font_string_height / 2);
-	fontargs_render_string ();
+	fontargs_render_string_cached ();
 }
 
 
@@ -422,7 +616,7 @@ void fontargs_render_string_right (const char *s)
 {
 	font_get_string_area (s);
 	font_args.coord.x = font_args.coord.x - font_string_width;
-	fontargs_render_string ();
+	fontargs_render_string_cached ();
 }
 
 void fontargs_render_glyph (U8 c)
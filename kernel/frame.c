@@ -61,32 +61,76 @@ struct frame_pointer
 #ifdef IMAGEMAP_PAGE
 
 #ifndef __m6809__
+/* The C decoders work a byte at a time, since the data is stored
+big-endian for the 6809. */
 void frame_decode_rle_c (U8 *data)
 {
-	U16 *src = (U16 *)data;
-	U16 *dst = (U16 *)dmd_low_buffer;
+	U8 *dst = dmd_low_window;
 
-	while ((U8 *)dst < dmd_low_buffer + 512)
+	for (;;)
 	{
-		U16 val = *src++;
-		if ((val & 0xFF00) == 0xA800)
+		if (*data != 0xA8)
 		{
-			U8 words = val & 0xFF;
-			U8 repeater = *((U8 *)src);
-			U16 repeated_word = repeater | ((U16)repeater << 8);
-			src = (U16 *)((U8 *)src + 1);
-			while (words > 0)
-			{
-				*dst++ = repeated_word;
-				words--;
-			}
+			*dst++ = *data++;
+			*dst++ = *data++;
+		}
+		else if (data[1] & 0x80)
+		{
+			/* End of image */
+			break;
+		}
+		else if (data[1] == 0)
+		{
+			/* Escaped 0xA8 data byte */
+			*dst++ = 0xA8;
+			*dst++ = data[2];
+			data += 3;
 		}
 		else
 		{
-			*dst++ = val;
+			/* Run of repeated words */
+			U8 words = data[1];
+			do {
+				*dst++ = data[2];
+				*dst++ = data[2];
+			} while (--words);
+			data += 3;
 		}
 	}
 }
+
+
+void frame_decode_sparse_c (U8 *data)
+{
+	U8 *dst = dmd_low_window;
+	U8 words;
+
+	dmd_clean_page (dst);
+	while ((words = *data++) != 0)
+	{
+		dst += *data++;
+		do {
+			*dst++ = *data++;
+			*dst++ = *data++;
+		} while (--words);
+	}
+}
+
+
+void frame_decode_delta_c (U8 *data)
+{
+	U8 *dst = dmd_low_window;
+	U8 words;
+
+	while ((words = *data++) != 0)
+	{
+		dst += *data++;
+		do {
+			*dst++ ^= *data++;
+			*dst++ ^= *data++;
+		} while (--words);
+	}
+}
 #endif
 
 
@@ -97,9 +141,11 @@ void frame_decode_rle_c (U8 *data)
  */
 void frame_decode (U8 *data, U8 type)
 {
+	/* Every frame type covers the whole page */
+	dmd_dirty_all (dmd_low_page);
 	if (type == 0)
 	{
-		dmd_copy_page (dmd_low_buffer, (const dmd_buffer_t)data);
+		dmd_copy_page (dmd_low_window, (const dmd_buffer_t)data);
 	}
 	else if (type == 2)
 	{
@@ -109,6 +155,12 @@ void frame_decode (U8 *data, U8 type)
 	{
 		frame_decode_sparse (data);
 	}
+	else if (type == 6)
+	{
+		/* Delta frames are applied on top of the previous frame,
+		which must still be in the low page */
+		frame_decode_delta (data);
+	}
 }
 
 /**
@@ -141,6 +193,34 @@ void frame_draw_plane (U16 id)
 }
 
 
+/**
+ * Return TRUE if either plane of a 4-color frame is stored as a delta
+ * from the previous frame.  Such a frame must be drawn on top of a copy
+ * of the previous one, for example with dmd_dup_mapped(); any other frame
+ * overwrites the whole page, so dmd_alloc_pair() is enough.
+ */
+bool frame_is_delta (U16 id)
+{
+	struct frame_pointer *p;
+	U8 *data;
+	U8 plane;
+	bool delta = FALSE;
+
+	page_push (IMAGEMAP_PAGE);
+	p = (struct frame_pointer *)IMAGEMAP_BASE + id;
+	for (plane = 0; plane < 2; plane++, p++)
+	{
+		data = PTR(p);
+		pinio_set_bank (PINIO_BANK_ROM, p->page);
+		if ((data[0] & ~0x1) == 6)
+			delta = TRUE;
+		pinio_set_bank (PINIO_BANK_ROM, IMAGEMAP_PAGE);
+	}
+	page_pop ();
+	return delta;
+}
+
+
 /**
  * Draw a 2-plane, 4-color DMD frame.
  * ID identifies the first plane of the frame.  The two
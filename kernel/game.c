@@ -259,6 +259,7 @@ void end_ball (void)
 	/* Stop tasks that should run only until end-of-ball. */
 	task_remove_duration (TASK_DURATION_BALL);
 	task_duration_expire (TASK_DURATION_BALL);
+	leff_program_expire (TASK_DURATION_BALL);
 	in_bonus = FALSE;
 
 	/* If the player has extra balls stacked, then start the
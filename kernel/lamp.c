@@ -86,6 +86,11 @@ __fastram__ lamp_strobe_t lamp_strobe_mask;
 
 __fastram__ U8 lamp_strobe_column;
 
+#ifdef CONFIG_LAMP_STROBE_SCHEDULE
+/** The position in lamp_strobe_schedule */
+__fastram__ U8 lamp_strobe_slot;
+#endif
+
 __fastram__ U8 lamp_power_timer;
 
 U8 lamp_power_level;
@@ -111,11 +116,20 @@ void lamp_init (void)
 	lamp_leff1_free_all ();
 	lamp_leff2_free_all ();
 
+#ifdef CONFIG_LAMP_STROBE_SCHEDULE
+	lamp_strobe_slot = 0;
+	lamp_strobe_column = lamp_strobe_schedule[0];
+	lamp_strobe_mask = single_bit_set (lamp_strobe_column);
+#else
 	lamp_strobe_mask = 0x1;
 	lamp_strobe_column = 0;
+#endif
 	lamp_power_timer = 0;
 	lamp_power_level = 0;
 	lamp_power_idle_timer = 0;
+#ifdef CONFIG_LAMP_FADE
+	lamp_fade_init ();
+#endif
 }
 
 
@@ -164,6 +178,13 @@ optimal.  The bitarray macros are preferred. */
 U8 single_bit_set_array[8] = { 0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80 };
 #endif
 
+#ifndef CONFIG_NATIVE
+/* The lowest bit set in each 4-bit value, for low_bit_number() */
+const U8 low_bit_nibble_array[16] = {
+	0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+#endif
+
 void bit_on (bitset matrix, U8 bit)
 {
 	bitarray_set (matrix, bit);
@@ -332,6 +353,9 @@ void lamp_all_off (void)
 	lamp_set_zero (lamp_leff2_matrix);
 	enable_interrupts ();
 	lamp_set_zero (lamp_matrix);
+#ifdef CONFIG_LAMP_FADE
+	lamp_fade_all_off ();
+#endif
 }
 
 /*
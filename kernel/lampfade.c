@@ -0,0 +1,285 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Lamp brightness and fading.
+ *
+ * With CONFIG_LAMP_FADE, each lamp also has a brightness from 0 (off) to
+ * LAMP_BRIGHTNESS_MAX.  The brightness is stored as LAMP_FADE_PLANES bit
+ * planes, each of which is a lamp_set.  Every time that the lamp matrix
+ * has been strobed once, lamp_rtt calls lamp_fade_next_plane() to select
+ * the next plane from lamp_fade_sequence, and shows it by ORing it into
+ * the lamp outputs, the same way as the flashing lamps.  Plane N is shown
+ * for 2^N scans out of every LAMP_FADE_PHASES, so the time that a lamp is
+ * on is proportional to its brightness.  The sequence spreads the scans
+ * of each plane out, to keep flicker down.  Switching at the end of a scan
+ * keeps every column on the same plane, however the scan is scheduled.
+ *
+ * Since the planes are only ORed in, the brightness of a lamp is only seen
+ * when its basic state is off, as for lamp_flash_on().  Lamp effects which
+ * allocate the lamp override it as usual.
+ *
+ * A fade moves a lamp from its current brightness to a new one, one level
+ * at a time, over a given number of ticks.  Fades are stepped by
+ * lamp_fade_rtt(), so that no task is needed to run them.  Up to
+ * LAMP_FADE_SLOTS lamps can be fading at once; if there are more, the
+ * extra lamps change brightness immediately.
+ *
+ * To bound the time spent in the IRQ, the RTT only visits the fades in
+ * use, and changes at most LAMP_FADE_STEPS lamps per tick.  A step beyond
+ * that is put off until the next tick, which slows down a fade of many
+ * lamps at once slightly but is not otherwise visible.
+ */
+
+#include <freewpc.h>
+
+/** The bit planes for all lamps */
+lamp_set lamp_fade_plane[LAMP_FADE_PLANES];
+
+/** The plane that lamp_rtt is showing now */
+__fastram__ const U8 *lamp_fade_plane_now;
+
+/** The position in lamp_fade_sequence */
+U8 lamp_fade_phase;
+
+/** The order in which the planes are shown.  Plane N appears 2^N times. */
+static const U8 lamp_fade_sequence[LAMP_FADE_PHASES] = {
+	2, 1, 2, 0, 2, 1, 2
+};
+
+/** A lamp whose brightness is changing */
+struct lamp_fade
+{
+	/** The lamp */
+	lampnum_t lamp;
+
+	/** The current and final brightness */
+	U8 level;
+	U8 target;
+
+	/** The number of ticks between steps, and until the next step */
+	U8 period;
+	U8 timer;
+};
+
+/** The lamps that are fading.  Only the first lamp_fade_count slots are
+in use; freeing a slot moves the last one into its place. */
+struct lamp_fade lamp_fade_table[LAMP_FADE_SLOTS];
+
+/** The number of slots in use */
+U8 lamp_fade_count;
+
+
+/** Write the brightness of a lamp into the bit planes.  Interrupts
+must be disabled. */
+static void lamp_fade_write (lampnum_t lamp, U8 level)
+{
+	U8 plane;
+
+	for (plane = 0; plane < LAMP_FADE_PLANES; plane++)
+	{
+		if (level & 1)
+			bitarray_set (lamp_fade_plane[plane], lamp);
+		else
+			bitarray_clear (lamp_fade_plane[plane], lamp);
+		level >>= 1;
+	}
+}
+
+
+/** Return the fade slot for a lamp, or NULL if it is not fading.
+Interrupts must be disabled. */
+static struct lamp_fade *lamp_fade_find (lampnum_t lamp)
+{
+	struct lamp_fade *fade;
+
+	for (fade = lamp_fade_table; fade < &lamp_fade_table[lamp_fade_count]; fade++)
+		if (fade->lamp == lamp)
+			return fade;
+	return NULL;
+}
+
+
+/** Stop a fade, leaving the lamp at its current brightness.
+Interrupts must be disabled. */
+static void lamp_fade_free (struct lamp_fade *fade)
+{
+	*fade = lamp_fade_table[--lamp_fade_count];
+}
+
+
+/** Show the next bit plane.  This is called by lamp_rtt after each
+complete scan of the lamp matrix. */
+void lamp_fade_next_plane (void)
+{
+	if (++lamp_fade_phase == LAMP_FADE_PHASES)
+		lamp_fade_phase = 0;
+	lamp_fade_plane_now = lamp_fade_plane[lamp_fade_sequence[lamp_fade_phase]];
+}
+
+
+/** Step the lamps that are fading. */
+/* RTT(name=lamp_fade_rtt freq=16) */
+void lamp_fade_rtt (void)
+{
+	struct lamp_fade *fade;
+	U8 steps;
+
+	if (likely (lamp_fade_count == 0))
+		return;
+
+	steps = LAMP_FADE_STEPS;
+	fade = lamp_fade_table;
+	while (fade < &lamp_fade_table[lamp_fade_count])
+	{
+		if (--fade->timer != 0)
+		{
+			fade++;
+			continue;
+		}
+		if (steps == 0)
+		{
+			/* Try again on the next tick */
+			fade->timer = 1;
+			fade++;
+			continue;
+		}
+		steps--;
+
+		fade->timer = fade->period;
+		if (fade->level < fade->target)
+			fade->level++;
+		else
+			fade->level--;
+		lamp_fade_write (fade->lamp, fade->level);
+
+		/* Freeing the slot moves a fade that has not been visited
+		yet into this one */
+		if (fade->level == fade->target)
+			lamp_fade_free (fade);
+		else
+			fade++;
+	}
+}
+
+
+/** Read the brightness of a lamp from the bit planes.  Interrupts
+must be disabled. */
+static U8 lamp_fade_read (lampnum_t lamp)
+{
+	U8 plane = LAMP_FADE_PLANES;
+	U8 level = 0;
+
+	do {
+		plane--;
+		level <<= 1;
+		if (bitarray_test (lamp_fade_plane[plane], lamp))
+			level |= 1;
+	} while (plane != 0);
+	return level;
+}
+
+
+/** Return the brightness of a lamp. */
+U8 lamp_brightness_get (lampnum_t lamp)
+{
+	U8 level;
+
+	disable_interrupts ();
+	level = lamp_fade_read (lamp);
+	enable_interrupts ();
+	return level;
+}
+
+
+/** Fade a lamp from its current brightness to LEVEL over about TICKS
+ticks.  The lamp changes by one level at a time, so a fade always takes
+at least one tick per level.  If TICKS is zero, the change is immediate. */
+void lamp_fade (lampnum_t lamp, U8 level, U8 ticks)
+{
+	struct lamp_fade *fade;
+	U8 current;
+	U8 steps;
+
+	disable_interrupts ();
+	current = lamp_fade_read (lamp);
+	steps = (current < level) ? level - current : current - level;
+
+	fade = lamp_fade_find (lamp);
+	if (!fade && steps != 0 && ticks != 0
+		&& lamp_fade_count < LAMP_FADE_SLOTS)
+		fade = &lamp_fade_table[lamp_fade_count++];
+
+	if (!fade)
+		lamp_fade_write (lamp, level);
+	else if (steps == 0 || ticks == 0)
+	{
+		lamp_fade_free (fade);
+		lamp_fade_write (lamp, level);
+	}
+	else
+	{
+		fade->lamp = lamp;
+		fade->level = current;
+		fade->target = level;
+		fade->period = (ticks > steps) ? ticks / steps : 1;
+		fade->timer = fade->period;
+	}
+	enable_interrupts ();
+}
+
+
+/** Set the brightness of a lamp immediately, stopping any fade. */
+void lamp_brightness_set (lampnum_t lamp, U8 level)
+{
+	lamp_fade (lamp, level, 0);
+}
+
+
+/** Fade every lamp in a lamplist. */
+void lamplist_fade (lamplist_id_t id, U8 level, U8 ticks)
+{
+	lampnum_t lamp;
+	U8 n;
+
+	for (n = 0; (lamp = lamplist_index (id, n)) != LAMP_END; n++)
+		if (lamp != LAMP_BREAK)
+			lamp_fade (lamp, level, ticks);
+}
+
+
+/** Set every lamp to zero brightness, and stop all fades. */
+void lamp_fade_all_off (void)
+{
+	disable_interrupts ();
+	memset (lamp_fade_plane, 0, sizeof (lamp_fade_plane));
+	lamp_fade_count = 0;
+	enable_interrupts ();
+}
+
+
+/** Initialize the fade engine at startup. */
+void lamp_fade_init (void)
+{
+	lamp_fade_all_off ();
+	lamp_fade_phase = 0;
+	lamp_fade_plane_now = lamp_fade_plane[lamp_fade_sequence[0]];
+}
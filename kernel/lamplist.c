@@ -40,6 +40,13 @@
  * value LAMP_END.  Within a lamplist you can also encode "breaks",
  * which separate one lamplist into multiple sections.  This allows
  * an additional delay to be applied.
+ *
+ * genmachine also writes the lampset for each lamplist.  When one of
+ * the standard operators is applied to a whole lamplist, and no delay
+ * between lamps is needed, the lampset is combined with the lamp matrix
+ * directly instead of walking the list.  The same is done for the
+ * standard tests.  Other operators, and leffs which sleep between lamps,
+ * still go through the list one entry at a time.
  */
 
 #include <freewpc.h>
@@ -47,6 +54,15 @@
 /** A table of pointers to all of the defined lamplists */
 extern const lampnum_t *lamplist_table[];
 
+/** A table of pointers to the lampset for each lamplist, or NULL
+if it does not have one */
+extern const U8 * const lampset_table[];
+
+extern __fastram__ lamp_set lamp_leff1_allocated;
+extern __fastram__ lamp_set lamp_leff1_matrix;
+extern __fastram__ lamp_set lamp_leff2_allocated;
+extern __fastram__ lamp_set lamp_leff2_matrix;
+
 
 U8 lamplist_alternation_state;
 
@@ -144,15 +160,100 @@ static void lamplist_leff_sleep (U8 delay)
 }
 
 
+/** Returns the lamp matrix used by the leff_ operators in the
+current task. */
+static inline bitset leff_matrix (void)
+{
+	return (leff_running_flags & L_SHARED) ?
+		lamp_leff2_matrix : lamp_leff1_matrix;
+}
+
+
+/** Apply an operator to all of the lamps in a lampset at once.  This
+gives the same result as calling it for each lamp.  Returns FALSE if
+the operator is not one that can be done this way; nothing is changed
+then. */
+static bool lampset_apply (const U8 *set, lamp_operator_t op)
+{
+	if (op == lamp_on)
+		lamp_set_add (lamp_matrix, set);
+	else if (op == lamp_off)
+		lamp_set_subtract (lamp_matrix, set);
+	else if (op == lamp_toggle)
+		lamp_set_toggle (lamp_matrix, set);
+	else if (op == leff_on)
+		lamp_set_add (leff_matrix (), set);
+	else if (op == leff_off)
+		lamp_set_subtract (leff_matrix (), set);
+	else if (op == leff_toggle)
+		lamp_set_toggle (leff_matrix (), set);
+	else if (op == lamp_flash_on)
+	{
+		/* Lamps which were not already flashing start in the same
+		state as the ones that were; see lamp_flash_on(). */
+		lamp_set newly_flashing;
+		lamp_set_copy (newly_flashing, set);
+		lamp_set_subtract (newly_flashing, lamp_flash_matrix);
+		lamp_set_add (lamp_flash_matrix, set);
+		disable_interrupts ();
+		if (!bit_test_all_off (lamp_flash_matrix_now))
+			lamp_set_add (lamp_flash_matrix_now, newly_flashing);
+		else
+			lamp_set_subtract (lamp_flash_matrix_now, newly_flashing);
+		enable_interrupts ();
+	}
+	else if (op == lamp_flash_off)
+	{
+		lamp_set_subtract (lamp_flash_matrix, set);
+		lamp_set_subtract (lamp_flash_matrix_now, set);
+	}
+	else if (op == lamp_leff_allocate)
+		lamp_set_subtract (lamp_leff1_allocated, set);
+	else if (op == lamp_leff_free)
+		lamp_set_add (lamp_leff1_allocated, set);
+	else if (op == lamp_leff2_allocate)
+	{
+		lamp_set_subtract (lamp_leff2_matrix, set);
+		lamp_set_subtract (lamp_leff2_allocated, set);
+	}
+	else if (op == lamp_leff2_free)
+	{
+		lamp_set_add (lamp_leff2_allocated, set);
+		lamp_set_subtract (lamp_leff2_matrix, set);
+	}
+	else
+		return FALSE;
+	return TRUE;
+}
+
+
+/** Returns the matrix examined by a boolean lamp operator, or NULL
+if it is not one of the standard tests. */
+static const_bitset lampset_test_matrix (lamp_boolean_operator_t op)
+{
+	if (op == lamp_test || op == lamp_test_off)
+		return lamp_matrix;
+	else if (op == lamp_flash_test)
+		return lamp_flash_matrix;
+	else if (op == leff_test)
+		return leff_matrix ();
+	else
+		return NULL;
+}
+
+
 /** Apply an operator to each element of a lamplist, without executing
 any lamp macros. */
 void lamplist_apply_nomacro (lamplist_id_t id, lamp_operator_t op)
 {
 	register const lampnum_t *entry;
 	page_push (MD_PAGE);
-	for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
-		if (!lamp_macro (*entry))
-			(*op) (*entry);
+	if (!lampset_table[id] || !lampset_apply (lampset_table[id], op))
+	{
+		for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
+			if (!lamp_macro (*entry))
+				(*op) (*entry);
+	}
 	page_pop ();
 }
 
@@ -166,30 +267,37 @@ void lamplist_apply (lamplist_id_t id, lamp_operator_t op)
 
 	page_push (MD_PAGE);
 
-	for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
+	/* Without a delay, breaks do nothing and the order in which the
+	lamps are changed does not matter, so the lampset can be used. */
+	if (!lampset_table[id]
+		|| (leff_caller_p () && lamplist_apply_delay != 0)
+		|| !lampset_apply (lampset_table[id], op))
 	{
-		switch (*entry)
+		for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
 		{
-			case LAMP_BREAK:
-				if (leff_caller_p () && (lamplist_apply_delay != 0))
-				{
-					lamplist_apply_delay1 = lamplist_apply_delay;
-					lamplist_apply_delay = 0;
-				}
-
-				if (lamplist_apply_delay1)
-					lamplist_leff_sleep (lamplist_apply_delay1);
-				break;
-
-			default:
-				(*op) (*entry);
-				lamplist_leff_sleep (lamplist_apply_delay);
-				break;
+			switch (*entry)
+			{
+				case LAMP_BREAK:
+					if (leff_caller_p () && (lamplist_apply_delay != 0))
+					{
+						lamplist_apply_delay1 = lamplist_apply_delay;
+						lamplist_apply_delay = 0;
+					}
+
+					if (lamplist_apply_delay1)
+						lamplist_leff_sleep (lamplist_apply_delay1);
+					break;
+
+				default:
+					(*op) (*entry);
+					lamplist_leff_sleep (lamplist_apply_delay);
+					break;
+			}
 		}
-	}
 
-	if (lamplist_apply_delay1 != 0)
-		lamplist_apply_delay = lamplist_apply_delay1;
+		if (lamplist_apply_delay1 != 0)
+			lamplist_apply_delay = lamplist_apply_delay1;
+	}
 	page_pop ();
 }
 
@@ -219,18 +327,31 @@ as the result is known. */
 bool lamplist_test_all (lamplist_id_t id, lamp_boolean_operator_t op)
 {
 	register const lampnum_t *entry;
+	const U8 *set;
+	const_bitset matrix;
 	bool result = TRUE;
 
 	page_push (MD_PAGE);
 
-	for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
+	set = lampset_table[id];
+	if (set && (matrix = lampset_test_matrix (op)) != NULL)
 	{
-		if (lamp_macro (*entry))
-			continue;
-		if (!op (*entry))
+		if (op == lamp_test_off)
+			result = lamp_set_disjoint (matrix, set);
+		else
+			result = lamp_set_contains (matrix, set);
+	}
+	else
+	{
+		for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
 		{
-			result = FALSE;
-			break;
+			if (lamp_macro (*entry))
+				continue;
+			if (!op (*entry))
+			{
+				result = FALSE;
+				break;
+			}
 		}
 	}
 
@@ -245,18 +366,31 @@ as the result is known. */
 bool lamplist_test_any (lamplist_id_t id, lamp_boolean_operator_t op)
 {
 	register const lampnum_t *entry;
+	const U8 *set;
+	const_bitset matrix;
 	bool result = FALSE;
 
 	page_push (MD_PAGE);
 
-	for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
+	set = lampset_table[id];
+	if (set && (matrix = lampset_test_matrix (op)) != NULL)
 	{
-		if (lamp_macro (*entry))
-			continue;
-		if (op (*entry))
+		if (op == lamp_test_off)
+			result = !lamp_set_contains (matrix, set);
+		else
+			result = !lamp_set_disjoint (matrix, set);
+	}
+	else
+	{
+		for (entry = lamplist_table[id]; *entry != LAMP_END; entry++)
 		{
-			result = TRUE;
-			break;
+			if (lamp_macro (*entry))
+				continue;
+			if (op (*entry))
+			{
+				result = TRUE;
+				break;
+			}
 		}
 	}
 
@@ -347,16 +481,16 @@ void lamplist_step_decrement (lamplist_id_t set, bitset matrix)
 	if (bit_test_all_off (matrix))
 	{
 		entry = lamplist_last_entry (set);
-		lamp_on (*entry);
+		bit_on (matrix, *entry);
 	}
 	else
 	{
 		entry = lamplist_find (set, matrix_test_operator (matrix));
-		lamp_off (*entry);
+		bit_off (matrix, *entry);
 		entry = lamplist_previous_entry (set, entry);
 		if (entry < lamplist_first_entry (set))
 			entry = lamplist_last_entry (set);
-		lamp_on (*entry);
+		bit_on (matrix, *entry);
 	}
 	page_pop ();
 	lamplist_leff_sleep (lamplist_apply_delay);
@@ -23,10 +23,23 @@
 /**
  * Lamp set low-level operators.  Each lamp set is just a bitmap,
  * one bit per resource (lamp/GI string/flasher).  These are
- * optimized according to the maximum number of resources we have.
+ * optimized according to the maximum number of resources we have:
+ * the sets are processed 16 bits at a time when they are an even number
+ * of bytes long, and 8 bits at a time otherwise.
+ *
+ * The lamplist functions use these together with the lampsets generated
+ * for each lamplist, so that common operations on a whole lamplist do
+ * not need to visit each lamp.
  */
 
-/* TODO - look at PINIO_NUM_LAMPS */
+#if (NUM_LAMP_COLS % 2) == 0
+typedef U16 lamp_set_word_t;
+#else
+typedef U8 lamp_set_word_t;
+#endif
+
+#define LAMP_SET_WORDS (NUM_LAMP_COLS / sizeof (lamp_set_word_t))
+
 
 void lamp_set_zero (lamp_set dst)
 {
@@ -35,59 +48,66 @@ void lamp_set_zero (lamp_set dst)
 
 void lamp_set_copy (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
-
-	dst1[0] = src1[0];
-	dst1[1] = src1[1];
-	dst1[2] = src1[2];
-	dst1[3] = src1[3];
-	dst1[4] = src1[4];
-	dst1[5] = src1[5];
+	register lamp_set_word_t *dst1 = (lamp_set_word_t *)dst;
+	register const lamp_set_word_t *src1 = (const lamp_set_word_t *)src;
+	U8 n;
+
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		dst1[n] = src1[n];
 }
 
 void lamp_set_add (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
-
-	dst1[0] |= src1[0];
-	dst1[1] |= src1[1];
-	dst1[2] |= src1[2];
-	dst1[3] |= src1[3];
-	dst1[4] |= src1[4];
-	dst1[5] |= src1[5];
+	register lamp_set_word_t *dst1 = (lamp_set_word_t *)dst;
+	register const lamp_set_word_t *src1 = (const lamp_set_word_t *)src;
+	U8 n;
+
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		dst1[n] |= src1[n];
 }
 
 void lamp_set_subtract (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
-
-	dst1[0] &= ~src1[0];
-	dst1[1] &= ~src1[1];
-	dst1[2] &= ~src1[2];
-	dst1[3] &= ~src1[3];
-	dst1[4] &= ~src1[4];
-	dst1[5] &= ~src1[5];
+	register lamp_set_word_t *dst1 = (lamp_set_word_t *)dst;
+	register const lamp_set_word_t *src1 = (const lamp_set_word_t *)src;
+	U8 n;
+
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		dst1[n] &= ~src1[n];
 }
 
+void lamp_set_toggle (lamp_set dst, const lamp_set src)
+{
+	register lamp_set_word_t *dst1 = (lamp_set_word_t *)dst;
+	register const lamp_set_word_t *src1 = (const lamp_set_word_t *)src;
+	U8 n;
+
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		dst1[n] ^= src1[n];
+}
+
+/** Return TRUE if no lamp is in both sets. */
 bool lamp_set_disjoint (const lamp_set a, const lamp_set b)
 {
-	register U16 *a1 = (U16 *)a;
-	register U16 *b1 = (U16 *)b;
-
-	/* In each component, a zero value means there is conflict
-	(both a and b are 1).  So when all are nonzero, there is
-	no conflict and the sets are disjoint. */
-	if (((a1[0] ^ b1[0]) | ~a1[0]) &&
-		 ((a1[1] ^ b1[1]) | ~a1[1]) &&
-		 ((a1[2] ^ b1[2]) | ~a1[2]) &&
-		 ((a1[3] ^ b1[3]) | ~a1[3]) &&
-		 ((a1[4] ^ b1[4]) | ~a1[4]) &&
-		 ((a1[5] ^ b1[5]) | ~a1[5]))
-		return TRUE;
-	return FALSE;
+	register const lamp_set_word_t *a1 = (const lamp_set_word_t *)a;
+	register const lamp_set_word_t *b1 = (const lamp_set_word_t *)b;
+	U8 n;
+
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		if (a1[n] & b1[n])
+			return FALSE;
+	return TRUE;
 }
 
+/** Return TRUE if every lamp in 'subset' is also in 'set'. */
+bool lamp_set_contains (const lamp_set set, const lamp_set subset)
+{
+	register const lamp_set_word_t *a1 = (const lamp_set_word_t *)set;
+	register const lamp_set_word_t *b1 = (const lamp_set_word_t *)subset;
+	U8 n;
 
+	for (n = 0; n < LAMP_SET_WORDS; n++)
+		if (b1[n] & ~a1[n])
+			return FALSE;
+	return TRUE;
+}
@@ -57,26 +57,50 @@
 /** Indicates in a leff definition that it allocates all GI */
 #define L_ALL_GI		PINIO_GI_STRINGS
 
+/** Indicates in a leff definition that it does not allocate any flashers */
+#define L_NOFLASHERS	0xFF
+
+/** Indicates in a leff definition that it allocates all flashers */
+#define L_ALL_FLASHERS	0xFE
+
 /* Declare externs for all of the deff functions */
-#define DECL_LEFF(num, flags, pri, b1, b2, fn, fnpage) \
+#define DECL_LEFF(num, flags, pri, b1, b2, b3, fn, fnpage) \
 	extern void fn (void);
+#define DECL_LEFF_PROGRAM(num, flags, pri, b1, b2, b3, prog, fnpage) \
+	extern const U8 prog[];
 #ifdef MACHINE_LAMP_EFFECTS
 MACHINE_LAMP_EFFECTS
 #endif
 
 /* Now declare the deff table itself */
 #undef DECL_LEFF
-#define DECL_LEFF(num, flags, pri, b1, b2, fn, fnpage) \
-	[num] = { flags, pri, b1, b2, fn, fnpage },
+#undef DECL_LEFF_PROGRAM
+#define DECL_LEFF(num, flags, pri, b1, b2, b3, fn, fnpage) \
+	[num] = { flags, pri, b1, b2, b3, fn, fnpage },
+#define DECL_LEFF_PROGRAM(num, flags, pri, b1, b2, b3, prog, fnpage) \
+	[num] = { (flags) | L_PROGRAM, pri, b1, b2, b3, NULL, fnpage },
 
 static const leff_t leff_table[] = {
 #define null_leff leff_exit
-	[LEFF_NULL] = { L_NORMAL, 0, 0, 0, NULL, 0 },
+	[LEFF_NULL] = { L_NORMAL, 0, 0, 0, L_NOFLASHERS, NULL, 0 },
 #ifdef MACHINE_LAMP_EFFECTS
 	MACHINE_LAMP_EFFECTS
 #endif
 };
 
+/* And the programs for the leffs that are not functions */
+#ifdef MACHINE_LEFF_PROGRAMS
+#undef DECL_LEFF
+#undef DECL_LEFF_PROGRAM
+#define DECL_LEFF(num, flags, pri, b1, b2, b3, fn, fnpage)
+#define DECL_LEFF_PROGRAM(num, flags, pri, b1, b2, b3, prog, fnpage) \
+	[num] = prog,
+
+static const U8 * const leff_program_table[MAX_LEFFS] = {
+	MACHINE_LAMP_EFFECTS
+};
+#endif
+
 
 /* Declare externs for lamp bit matrices used by leffs */
 extern __fastram__ lamp_set lamp_leff1_allocated;
@@ -92,6 +116,26 @@ U8 leff_prio;
  * otherwise. */
 U8 leffs_running[BITS_TO_BYTES (MAX_LEFFS)];
 
+/** The leffs marked L_RUNNING, which can be resumed after they are
+ * preempted, sorted by priority: the most important is first.  Leffs
+ * of equal priority are kept in numerical order. */
+U8 leff_rank_table[MAX_LEFFS];
+
+/** The position of each leff in leff_rank_table, or 0xFF if it is
+ * not there */
+U8 leff_rank_of[MAX_LEFFS];
+
+/** The number of entries in leff_rank_table */
+U8 leff_rank_count;
+
+/** A bitarray indexed by rank, in which a '1' means that the leff at
+ * that position in leff_rank_table is running.  The lowest bit set is
+ * the leff that ought to have the lamps. */
+U8 leffs_ranked[BITS_TO_BYTES (MAX_LEFFS)];
+
+/** The task for each shared leff that is running */
+task_pid_t leff_shared_pid[MAX_LEFFS];
+
 void leff_dump (void)
 {
 }
@@ -103,6 +147,53 @@ bool leff_running_p (leffnum_t dn)
 }
 
 
+/** Mark a lamp effect as running. */
+static void leff_set_running (leffnum_t dn)
+{
+	bitarray_set (leffs_running, dn);
+	if (leff_rank_of[dn] != 0xFF)
+		bitarray_set (leffs_ranked, leff_rank_of[dn]);
+}
+
+
+/** Mark a lamp effect as stopped. */
+static void leff_clear_running (leffnum_t dn)
+{
+	bitarray_clear (leffs_running, dn);
+	if (leff_rank_of[dn] != 0xFF)
+		bitarray_clear (leffs_ranked, leff_rank_of[dn]);
+}
+
+
+/** Sort the resumable leffs by priority, to fill in leff_rank_table. */
+static void leff_rank_init (void)
+{
+	leffnum_t dn;
+	U8 n;
+
+	leff_rank_count = 0;
+	for (dn = 0; dn < MAX_LEFFS; dn++)
+	{
+		leff_rank_of[dn] = 0xFF;
+		if (!(leff_table[dn].flags & L_RUNNING))
+			continue;
+
+		/* Insert after everything of the same or higher priority */
+		n = leff_rank_count;
+		while (n > 0 && leff_table[leff_rank_table[n-1]].prio < leff_table[dn].prio)
+		{
+			leff_rank_table[n] = leff_rank_table[n-1];
+			n--;
+		}
+		leff_rank_table[n] = dn;
+		leff_rank_count++;
+	}
+
+	for (n = 0; n < leff_rank_count; n++)
+		leff_rank_of[leff_rank_table[n]] = n;
+}
+
+
 /** Returns the ID of the highest priority exclusive lamp effect
  * still queued to run.  If none exist, LEFF_NULL is returned.
  * This function also updates the global leff_prio to the
@@ -111,27 +202,26 @@ bool leff_running_p (leffnum_t dn)
 static leffnum_t leff_get_highest_priority (void)
 {
 	U8 i;
-	U8 prio = 0;
-	U8 best = LEFF_NULL;
+	U8 bits;
+	U8 best;
 
-	for (i=0; i < MAX_LEFFS; i++)
+	for (i=0; i < BITS_TO_BYTES (MAX_LEFFS); i++)
 	{
-		if (leff_running_p (i))
+		bits = leffs_ranked[i];
+		if (bits)
 		{
-			const leff_t *leff = &leff_table[i];
-			if (leff->flags & L_RUNNING && leff->prio > prio)
-			{
-				prio = leff->prio;
-				best = i;
-			}
+			best = leff_rank_table[i * 8 + low_bit_number (bits)];
+
+			/* Save the priority of the best leff here */
+			leff_prio = leff_table[best].prio;
+
+			/* Return the leffnum of the best leff to the caller */
+			return best;
 		}
 	}
 
-	/* Save the priority of the best leff here */
-	leff_prio = prio;
-
-	/* Return the leffnum of the best leff to the caller */
-	return best;
+	leff_prio = 0;
+	return LEFF_NULL;
 }
 
 
@@ -139,8 +229,8 @@ static leffnum_t leff_get_highest_priority (void)
  * housekeeping before starting the task...
  *
  * If the leff has declared a lamplist, then those lamps
- * are allocated.  Likewise, if it needs GI, then those
- * strings are allocated.  Allocation disables the normal
+ * are allocated.  Likewise, if it needs GI or flashers, then those
+ * are allocated.  Allocation disables the normal
  * outputs and gives the effect priority.
  */
 task_pid_t leff_create_handler (const leff_t *leff)
@@ -148,6 +238,11 @@ task_pid_t leff_create_handler (const leff_t *leff)
 	task_pid_t tp;
 	leff_data_t *cdata;
 
+	/* Only one exclusive leff runs at a time, whether it is a task
+	or a program. */
+	if (!(leff->flags & L_SHARED))
+		leff_program_stop_exclusive ();
+
 	/* Allocate lamps needed by the lamp effect */
 	if (leff->lamplist != L_NOLAMPS)
 	{
@@ -185,25 +280,48 @@ task_pid_t leff_create_handler (const leff_t *leff)
 	}
 
 
-	/* Now all allocations are in place, start the lamp effect task.
-	 * This implicitly stops whatever leff was previously running
-	 * for a running task. */
-	if (leff->flags & L_SHARED)
-		tp = task_create_gid (GID_SHARED_LEFF, leff->fn);
-	else
-	{
 #ifdef CONFIG_GI
+	if (!(leff->flags & L_SHARED))
+	{
 		/* Free any existing GI allocations. */
 		gi_leff_free (PINIO_GI_STRINGS);
 
 		/* Allocate general illumination needed by the lamp effect */
 		if (leff->gi != L_NOGI)
 			gi_leff_allocate (leff->gi);
+	}
 #endif
-		/* Start the task */
-		tp = task_recreate_gid (GID_LEFF, leff->fn);
+
+	if (!(leff->flags & L_SHARED))
+	{
+		/* Likewise for flashers */
+		flasher_leff_free_all ();
+		if (leff->flashers == L_ALL_FLASHERS)
+			flasher_leff_allocate_all ();
+		else if (leff->flashers != L_NOFLASHERS)
+			flasher_leff_allocate (leff->flashers);
 	}
 
+#ifdef MACHINE_LEFF_PROGRAMS
+	/* A program is run by the leff interpreter, and has no task */
+	if (leff->flags & L_PROGRAM)
+	{
+		if (!(leff->flags & L_SHARED))
+			task_kill_gid (GID_LEFF);
+		leff_program_start (leff - leff_table,
+			leff_program_table[leff - leff_table], leff->flags, leff->page);
+		return NULL;
+	}
+#endif
+
+	/* Now all allocations are in place, start the lamp effect task.
+	 * This implicitly stops whatever leff was previously running
+	 * for a running task. */
+	if (leff->flags & L_SHARED)
+		tp = task_create_gid (GID_SHARED_LEFF, leff->fn);
+	else
+		tp = task_recreate_gid (GID_LEFF, leff->fn);
+
 	/* Initialize the new leff's private data before it runs */
 	cdata = task_init_class_data (tp, leff_data_t);
 	cdata->apply_delay = 0;
@@ -227,6 +345,17 @@ void leff_start (leffnum_t dn)
 	if (leff_running_p (dn))
 		return;
 
+#ifdef MACHINE_LEFF_PROGRAMS
+	/* A program can't start if all of the interpreter's slots are in
+	 * use.  This is handled the same way as a lack of priority. */
+	if ((leff->flags & L_PROGRAM) && !leff_program_can_start (leff->flags))
+	{
+		if (!(leff->flags & L_SHARED) && (leff->flags & L_RUNNING))
+			leff_set_running (dn);
+		return;
+	}
+#endif
+
 	/* Mark the leff as running now.  This is done regardless of its type. */
 	dbprintf ("Leff start %d\n", dn);
 	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_START, dn);
@@ -237,29 +366,33 @@ void leff_start (leffnum_t dn)
 	if (!(leff->flags & L_SHARED) && (leff->prio < leff_prio))
 	{
 		if (leff->flags & L_RUNNING)
-			bitarray_set (leffs_running, dn);
+			leff_set_running (dn);
 		return;
 	}
 
 	/* Either it is shared, or the highest priority exclusive
 	 * effect.  In either way, we can start it up now. */
-	bitarray_set (leffs_running, dn);
+	leff_set_running (dn);
 	task_pid_t tp = leff_create_handler (leff);
-	(task_class_data (tp, leff_data_t))->id = dn;
+	if (tp)
+		(task_class_data (tp, leff_data_t))->id = dn;
+	if (leff->flags & L_SHARED)
+		leff_shared_pid[dn] = tp;
 }
 
 
 /** Find the task that is running the specified lamp effect.
-Returns NULL if the task can't be found. */
+Returns NULL if the task can't be found.  The task is remembered
+when the leff starts, but it may have been killed since (e.g. at the
+end of a ball), and its entry reused by another task, so check that it
+is still running this leff. */
 static task_pid_t leff_find_shared (leffnum_t dn)
 {
-	/* TODO - this is slow */
-	task_pid_t tp = task_find_gid (GID_SHARED_LEFF);
-	while (tp && ((task_class_data (tp, leff_data_t))->id != dn))
-	{
-		tp = task_find_gid_next (tp, GID_SHARED_LEFF);
-	}
-	return tp;
+	task_pid_t tp = leff_shared_pid[dn];
+	if (tp && task_pid_gid (tp) == GID_SHARED_LEFF
+		&& (task_class_data (tp, leff_data_t))->id == dn)
+		return tp;
+	return NULL;
 }
 
 
@@ -273,7 +406,7 @@ void leff_stop (leffnum_t dn)
 		return;
 
 	/* Mark the leff as stopped. */
-	bitarray_clear (leffs_running, dn);
+	leff_clear_running (dn);
 
 	/* The leff is certainly running and needs to be stopped.
 	 * Find the task running the leff and  kill it. */
@@ -283,13 +416,17 @@ void leff_stop (leffnum_t dn)
 		running for the one we want to stop.
 		Its allocations must be freed and the task stopped. */
 		task_pid_t tp = leff_find_shared (dn);
-		if (tp)
+		if (tp || (leff->flags & L_PROGRAM))
 		{
 			dbprintf ("Leff stop %d\n", dn);
 			log_event (SEV_INFO, MOD_LAMP, EV_LEFF_STOP, dn);
-			task_kill_pid (tp);
+			if (tp)
+				task_kill_pid (tp);
+			else
+				leff_program_stop (dn);
 			lamplist_apply_nomacro (leff->lamplist, lamp_leff2_free);
 		}
+		leff_shared_pid[dn] = NULL;
 	}
 	else
 	{
@@ -328,12 +465,41 @@ void leff_start_highest_priority (void)
 	else
 	{
 		task_kill_gid (GID_LEFF);
+		leff_program_stop_exclusive ();
+		flasher_leff_free_all ();
 		lamp_leff1_erase ();
 		lamp_leff1_free_all ();
 	}
 }
 
 
+/** Finish a lamp effect that has exited on its own, by freeing what it
+ * allocated.  If it was the exclusive leff, start the highest priority
+ * one that is still queued. */
+void leff_finish (leffnum_t dn)
+{
+	const leff_t *leff = &leff_table[dn];
+
+	dbprintf ("Exiting leff %d\n", dn);
+	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_EXIT, dn);
+
+	leff_clear_running (dn);
+
+	if (leff->flags & L_SHARED)
+	{
+		lamplist_apply_nomacro (leff->lamplist, lamp_leff2_free);
+	}
+	else
+	{
+#ifdef CONFIG_GI
+		if (leff->gi != L_NOGI)
+			gi_leff_free (leff->gi);
+#endif
+		leff_start_highest_priority ();
+	}
+}
+
+
 /** Called from a lamp effect that wants to exit.
  * It will check to see if any other lamp effects are queued and
  * if so, start the highest priority one, after removing itself
@@ -341,33 +507,20 @@ void leff_start_highest_priority (void)
  */
 __noreturn__ void leff_exit (void)
 {
-	const leff_t *leff;
-	
-	dbprintf ("Exiting leff %d\n", leff_self_id);
-	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_EXIT, leff_self_id);
-
-	bitarray_clear (leffs_running, leff_self_id);
-	leff = &leff_table[leff_self_id];
-
 	if (leff_running_flags & L_SHARED)
 	{
-		lamplist_apply_nomacro (leff->lamplist, lamp_leff2_free);
+		if (leff_shared_pid[leff_self_id] == task_getpid ())
+			leff_shared_pid[leff_self_id] = NULL;
 	}
 	else
 	{
 		/* Note: global leffs can do leff_exit with peer
 		tasks still running ... they will eventually be
-		stopped, too */
-#ifdef CONFIG_GI
-		if (leff->gi != L_NOGI)
-			gi_leff_free (leff->gi);
-#endif
-		/* Change the GID so that we are no longer
-		 * considered a leff. */
+		stopped, too.  Change the GID so that we are no longer
+		considered a leff. */
 		task_setgid (GID_LEFF_EXITING);
-
-		leff_start_highest_priority ();
 	}
+	leff_finish (leff_self_id);
 	task_exit ();
 }
 
@@ -377,6 +530,9 @@ void leff_init (void)
 {
 	leff_prio = 0;
 	memset (leffs_running, 0, sizeof (leffs_running));
+	memset (leffs_ranked, 0, sizeof (leffs_ranked));
+	memset (leff_shared_pid, 0, sizeof (leff_shared_pid));
+	leff_rank_init ();
 }
 
 
@@ -387,9 +543,11 @@ void leff_stop_all (void)
 {
 	task_kill_gid (GID_LEFF);
 	task_kill_gid (GID_SHARED_LEFF);
+	leff_program_stop_all ();
 #ifdef CONFIG_GI
 	gi_leff_free (PINIO_GI_STRINGS);
 #endif
+	flasher_leff_free_all ();
 	lamp_leff1_free_all ();
 	lamp_leff1_erase ();
 	lamp_leff2_free_all ();
@@ -0,0 +1,401 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief The leff program interpreter.
+ *
+ * Most lamp effects just change some lamps, sleep, and repeat.  Written
+ * as functions, each one needs its own task, and often peer tasks as well.
+ * A leff declared with 'program' in the machine description is instead
+ * a byte array, written with the LEFF_xxx macros in leff.h, for example:
+ *
+ *    const U8 left_ramp_leff[] = {
+ *       LEFF_LOOP (4),
+ *          LEFF_FLASH (FLASH_RAMP1), LEFF_SLEEP (TIME_100MS),
+ *          LEFF_FLASH (FLASH_RAMP2), LEFF_SLEEP (TIME_100MS),
+ *       LEFF_NEXT,
+ *       LEFF_END
+ *    };
+ *
+ * All running programs are stepped by a single task, once per tick.
+ * Each keeps only a program counter, a timer, and its loop state.
+ * Lamp allocation, priorities and GI work exactly as for other leffs;
+ * leff.c calls leff_program_start() where it would otherwise create the
+ * leff's task, and LEFF_END does the same as leff_exit().  A program also
+ * has the duration that its task would have had, and is stopped by
+ * leff_program_expire() when that task would be killed by
+ * task_duration_expire(), for example at the end of a ball.
+ *
+ * The interpreter sets its own leff class data to that of each program
+ * before running it, so that leff_on() and the other leff functions update
+ * the right matrix.  Since it is not a GID_LEFF task, lamplist_apply()
+ * never sleeps on its behalf; LEFF_WALK does the per-lamp delays instead.
+ */
+
+#include <freewpc.h>
+
+/* Nothing here is needed unless the machine declares a leff program */
+#ifdef MACHINE_LEFF_PROGRAMS
+
+/** The number of programs which can run at once */
+#define LEFF_PROGRAM_SLOTS 6
+
+/** The deepest that LEFF_LOOPs can be nested */
+#define LEFF_PROGRAM_LOOPS 2
+
+/** The state of a running leff program */
+struct leff_program_state
+{
+	/** The leff, or LEFF_NULL if this slot is free */
+	leffnum_t id;
+
+	/** The flags from the leff descriptor */
+	U8 flags;
+
+	/** The ROM page that holds the program */
+	U8 page;
+
+	/** When the program should be stopped, as a task duration */
+	U8 duration;
+
+	/** The number of ticks until the next instruction runs */
+	U8 timer;
+
+	/** The next instruction */
+	const U8 *pc;
+
+	/** While in a LEFF_WALK, the position in the lamplist, and whether
+	a break has been seen */
+	U8 walk;
+	bool walk_grouped;
+
+	/** The loops in progress */
+	U8 depth;
+	const U8 *loop_start[LEFF_PROGRAM_LOOPS];
+	U8 loop_count[LEFF_PROGRAM_LOOPS];
+};
+
+struct leff_program_state leff_program_slot[LEFF_PROGRAM_SLOTS];
+
+/** The number of slots in use */
+U8 leff_program_count;
+
+static const lamp_operator_t leff_program_ops[] = {
+	[LEFF_OP_ON] = leff_on,
+	[LEFF_OP_OFF] = leff_off,
+	[LEFF_OP_TOGGLE] = leff_toggle,
+};
+
+static void (*const leff_program_steps[]) (lamplist_id_t, bitset) = {
+	[LEFF_STEP_STEP_UP] = lamplist_step_increment,
+	[LEFF_STEP_STEP_DOWN] = lamplist_step_decrement,
+	[LEFF_STEP_BUILD_UP] = lamplist_build_increment,
+	[LEFF_STEP_BUILD_DOWN] = lamplist_build_decrement,
+	[LEFF_STEP_ROTATE_UP] = lamplist_rotate_next,
+	[LEFF_STEP_ROTATE_DOWN] = lamplist_rotate_previous,
+};
+
+extern __fastram__ lamp_set lamp_leff1_matrix;
+extern __fastram__ lamp_set lamp_leff2_matrix;
+
+
+/** Read the operand at offset N from the current instruction */
+static inline U8 leff_program_arg (const struct leff_program_state *lp, U8 n)
+{
+	return far_read8 (lp->pc + n, lp->page);
+}
+
+
+/** Free a program's slot */
+static void leff_program_free (struct leff_program_state *lp)
+{
+	lp->id = LEFF_NULL;
+	leff_program_count--;
+}
+
+
+/** Take one step of a LOP_WALK.  This follows the rules of
+lamplist_apply() with a delay: each lamp is followed by the delay until
+the first break is seen, and after that, only the breaks are.  Returns
+TRUE when the walk is complete. */
+static bool leff_program_walk (struct leff_program_state *lp)
+{
+	lamp_operator_t op = leff_program_ops[leff_program_arg (lp, 1)];
+	lamplist_id_t set = leff_program_arg (lp, 2);
+	U8 delay = leff_program_arg (lp, 3);
+	lampnum_t lamp;
+
+	for (;;)
+	{
+		lamp = lamplist_index (set, lp->walk);
+		if (lamp == LAMP_END)
+		{
+			lp->walk = 0;
+			lp->walk_grouped = FALSE;
+			return TRUE;
+		}
+
+		lp->walk++;
+		if (lamp == LAMP_BREAK)
+		{
+			lp->walk_grouped = TRUE;
+			lp->timer = delay;
+			return FALSE;
+		}
+
+		op (lamp);
+		if (!lp->walk_grouped)
+		{
+			lp->timer = delay;
+			return FALSE;
+		}
+	}
+}
+
+
+/** Run a program until it sleeps or exits. */
+static void leff_program_run (struct leff_program_state *lp)
+{
+	leff_data_t *cdata = task_current_class_data (leff_data_t);
+	bitset matrix;
+	U8 n;
+
+	cdata->flags = lp->flags;
+	cdata->id = lp->id;
+	matrix = (lp->flags & L_SHARED) ? lamp_leff2_matrix : lamp_leff1_matrix;
+
+	while (lp->timer == 0)
+	{
+		switch (far_read8 (lp->pc, lp->page))
+		{
+			case LOP_END:
+				leff_program_free (lp);
+				leff_finish (cdata->id);
+				return;
+
+			case LOP_SLEEP:
+				lp->timer = leff_program_arg (lp, 1);
+				lp->pc += 2;
+				break;
+
+			case LOP_ON:
+				leff_on (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+
+			case LOP_OFF:
+				leff_off (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+
+			case LOP_TOGGLE:
+				leff_toggle (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+
+			case LOP_APPLY:
+				lamplist_apply (leff_program_arg (lp, 2),
+					leff_program_ops[leff_program_arg (lp, 1)]);
+				lp->pc += 3;
+				break;
+
+			case LOP_WALK:
+				if (leff_program_walk (lp))
+					lp->pc += 4;
+				break;
+
+			case LOP_STEP:
+				leff_program_steps[leff_program_arg (lp, 1)] (
+					leff_program_arg (lp, 2), matrix);
+				lp->pc += 3;
+				break;
+
+#ifdef CONFIG_GI
+			case LOP_GI_ON:
+				gi_leff_enable (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+
+			case LOP_GI_OFF:
+				gi_leff_disable (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+#endif
+
+			case LOP_FLASH:
+				flasher_pulse (leff_program_arg (lp, 1));
+				lp->pc += 2;
+				break;
+
+			case LOP_LOOP:
+				if (lp->depth == LEFF_PROGRAM_LOOPS)
+					fatal (ERR_INVALID_LEFF_CONFIG);
+				n = lp->depth++;
+				lp->loop_count[n] = leff_program_arg (lp, 1);
+				lp->pc += 2;
+				lp->loop_start[n] = lp->pc;
+				break;
+
+			case LOP_NEXT:
+				if (lp->depth == 0)
+					fatal (ERR_INVALID_LEFF_CONFIG);
+				n = lp->depth - 1;
+				if (lp->loop_count[n] == 0 || --lp->loop_count[n] != 0)
+					lp->pc = lp->loop_start[n];
+				else
+				{
+					lp->depth--;
+					lp->pc++;
+				}
+				break;
+
+			default:
+				fatal (ERR_INVALID_LEFF_CONFIG);
+		}
+	}
+}
+
+
+/** The task that runs all of the leff programs.  It exits when there
+are none left. */
+static void leff_program_task (void)
+{
+	struct leff_program_state *lp;
+
+	while (leff_program_count != 0)
+	{
+		for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		{
+			if (lp->id == LEFF_NULL)
+				continue;
+			if (lp->timer != 0)
+				lp->timer--;
+			leff_program_run (lp);
+		}
+		task_sleep (TIME_16MS);
+	}
+	task_exit ();
+}
+
+
+/** Return TRUE if a program with the given flags can be started.
+An exclusive program replaces the one that is running, if any, so it
+can take that slot; otherwise, a free slot is needed. */
+bool leff_program_can_start (U8 flags)
+{
+	struct leff_program_state *lp;
+
+	if (leff_program_count < LEFF_PROGRAM_SLOTS)
+		return TRUE;
+	if (!(flags & L_SHARED))
+		for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+			if (!(lp->flags & L_SHARED))
+				return TRUE;
+	return FALSE;
+}
+
+
+/** Start running a leff program.  This is called by leff.c after the
+lamps and GI for the leff have been allocated.  leff_start() has already
+checked that there is a free slot; if there still is not, the program
+is not run. */
+void leff_program_start (leffnum_t dn, const U8 *program, U8 flags, U8 page)
+{
+	struct leff_program_state *lp;
+	task_pid_t tp;
+	leff_data_t *cdata;
+
+	for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		if (lp->id == LEFF_NULL)
+			break;
+	if (lp == &leff_program_slot[LEFF_PROGRAM_SLOTS])
+	{
+		dbprintf ("No slot for leff program %d\n", dn);
+		return;
+	}
+
+	lp->id = dn;
+	lp->flags = flags;
+	lp->page = (page == 0xFF) ? SYS_PAGE : page;
+	lp->duration = TASK_DURATION_BALL;
+	lp->timer = 0;
+	lp->pc = program;
+	lp->walk = 0;
+	lp->walk_grouped = FALSE;
+	lp->depth = 0;
+	leff_program_count++;
+
+	if (!task_find_gid (GID_LEFF_PROGRAM))
+	{
+		tp = task_create_gid (GID_LEFF_PROGRAM, leff_program_task);
+		task_set_duration (tp, TASK_DURATION_INF);
+		cdata = task_init_class_data (tp, leff_data_t);
+		cdata->apply_delay = 0;
+		cdata->data = 0;
+	}
+}
+
+
+/** Stop a leff program, without any of the cleanup of leff_finish(). */
+void leff_program_stop (leffnum_t dn)
+{
+	struct leff_program_state *lp;
+
+	for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		if (lp->id == dn)
+			leff_program_free (lp);
+}
+
+
+/** Stop the program for the exclusive leff, if there is one. */
+void leff_program_stop_exclusive (void)
+{
+	struct leff_program_state *lp;
+
+	for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		if (lp->id != LEFF_NULL && !(lp->flags & L_SHARED))
+			leff_program_free (lp);
+}
+
+
+/** Stop the programs whose duration matches, in the same way that
+task_duration_expire() kills the tasks of other leffs. */
+void leff_program_expire (U8 cond)
+{
+	struct leff_program_state *lp;
+
+	for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		if (lp->id != LEFF_NULL && (lp->duration & cond))
+			leff_program_free (lp);
+}
+
+
+/** Stop all leff programs. */
+void leff_program_stop_all (void)
+{
+	struct leff_program_state *lp;
+
+	for (lp = leff_program_slot; lp < &leff_program_slot[LEFF_PROGRAM_SLOTS]; lp++)
+		lp->id = LEFF_NULL;
+	leff_program_count = 0;
+}
+
+#endif /* MACHINE_LEFF_PROGRAMS */
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Reporting for the profiled IRQ schedule.
+ *
+ * With CONFIG_SCHED_PROFILE, tools/sched generates an IRQ handler that
+ * times each call that it makes (see rtt_profile_end() in interrupt.h).
+ * This module reports the results.
+ *
+ * The report has one line per call, giving the tick it runs in, its
+ * divider, the estimate from the schedule file, and the measured average
+ * and worst case:
+ *
+ *    RTT <name> <tick> <divider> <estimate> <average> <worst>
+ *
+ * followed by one line per tick, which totals the average and worst
+ * cases of every call in that tick.  On the 6809, times are in CPU cycles
+ * and the tick lines also give the average and worst load as a
+ * percentage of CYCLES_PER_TICK.  In native mode, times are host
+ * nanoseconds, and only the share of the total IRQ time is meaningful.
+ * All values are printed as 16-bit numbers, saturating at 65535.
+ */
+
+#include <freewpc.h>
+#include <printf.h>
+#include <interrupt.h>
+
+/** The time at which the current call began */
+rtt_profile_stamp_t rtt_profile_start;
+
+
+/** Limit a time to what can be printed */
+static U16 rtt_profile_u16 (U32 time)
+{
+	return (time > 0xFFFF) ? 0xFFFF : time;
+}
+
+
+/** Return the average time taken by a profiled call */
+static rtt_profile_time_t rtt_profile_average (const struct rtt_profile *prof)
+{
+	if (prof->count == 0)
+		return 0;
+	return prof->total / prof->count;
+}
+
+
+/** Clear all of the profile measurements */
+void rtt_profile_reset (void)
+{
+	disable_interrupts ();
+	memset (tick_profile, 0, tick_profile_slots * sizeof (struct rtt_profile));
+	enable_interrupts ();
+}
+
+
+#ifdef DEBUGGER
+void rtt_profile_dump (void)
+{
+	U8 n;
+	U8 tick;
+
+	for (n = 0; n < tick_profile_slots; n++)
+	{
+		const struct rtt_profile_info *info = &tick_profile_info[n];
+		const struct rtt_profile *prof = &tick_profile[n];
+
+		dbprintf ("RTT %s ", info->name);
+		dbprintf ("%d %d %ld ", info->tick, info->divider, info->estimate);
+		dbprintf ("%ld %ld\n", rtt_profile_u16 (rtt_profile_average (prof)),
+			rtt_profile_u16 (prof->worst));
+		task_runs_long ();
+	}
+
+	for (tick = 0; ; tick++)
+	{
+		U32 avg = 0;
+		U32 worst = 0;
+		bool found = FALSE;
+
+		for (n = 0; n < tick_profile_slots; n++)
+		{
+			const struct rtt_profile_info *info = &tick_profile_info[n];
+			if (info->tick != tick)
+				continue;
+			found = TRUE;
+			avg += rtt_profile_average (&tick_profile[n]) / info->divider;
+			worst += tick_profile[n].worst;
+		}
+		if (!found)
+			break;
+
+#ifdef CONFIG_NATIVE
+		dbprintf ("TICK %d %ld %ld\n", tick,
+			rtt_profile_u16 (avg), rtt_profile_u16 (worst));
+#else
+		dbprintf ("TICK %d %ld %ld %ld%% %ld%%\n", tick,
+			rtt_profile_u16 (avg), rtt_profile_u16 (worst),
+			rtt_profile_u16 (avg * 100 / tick_profile_cycles_per_tick),
+			rtt_profile_u16 (worst * 100 / tick_profile_cycles_per_tick));
+#endif
+		task_runs_long ();
+	}
+}
+#endif /* DEBUGGER */
+
+
+CALLSET_ENTRY (rtt_profile, init)
+{
+	rtt_profile_reset ();
+}
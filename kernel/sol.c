@@ -48,6 +48,13 @@
  * When using the shared driver, if another request is made while the driver
  * is already pulsing another solenoid, that request can be queued up
  * so the caller does not have to wait for it.
+ *
+ * Flashers can be allocated by a lamp effect, like lamps and GI.  While a
+ * flasher is allocated, pulses for it from anywhere else are ignored.
+ * Separately, the flasher update limits how many flashers are energized
+ * during any one duty cycle slot to MACHINE_FLASHER_BUDGET; a flasher
+ * that would exceed it waits for the next slot without losing any of its
+ * pulse time.
  */
 
 
@@ -65,6 +72,14 @@ U8 sol_duty_state[PINIO_NUM_SOLS - SOL_MIN_FLASHER];
 all devices, this mask is shifted.  At most one bit is ever set here at a time. */
 __fastram__ U8 sol_duty_mask;
 
+/** The flashers that are allocated by the running lamp effect.  The bits
+are laid out the same as in sol_reg_readable. */
+U8 sol_leff_alloc[SOL_REG_COUNT];
+
+/** The number of flashers that may still be turned on during the
+current duty cycle slot */
+__fastram__ U8 sol_flash_budget;
+
 /** The default values for the solenoid registers.  These are set by device drivers
 outside of this module, providing the initial on/off states for everything. */
 U8 sol_reg_readable[SOL_REG_COUNT];
@@ -339,6 +354,20 @@ void sol_req_rtt (void)
 }
 
 
+/** Returns true if the current task is the exclusive lamp effect,
+which owns any allocated flashers. */
+static bool flasher_leff_caller_p (void)
+{
+	if (task_getgid () == GID_LEFF)
+		return TRUE;
+#ifdef MACHINE_LEFF_PROGRAMS
+	if (task_getgid () == GID_LEFF_PROGRAM && !(leff_running_flags & L_SHARED))
+		return TRUE;
+#endif
+	return FALSE;
+}
+
+
 /** Starts a solenoid.  The duty_mask controls how much power is
 applied to the coil; the timeout says how long it should be
 applied.  Infinite timeout is *not* supported here, but can
@@ -350,6 +379,12 @@ macros in sys/sol.h instead. */
 __attribute__((noinline)) void
 sol_start_real (solnum_t sol, U8 duty_mask, U8 ticks)
 {
+	/* A flasher that a lamp effect has allocated can only be pulsed
+	 * by that effect. */
+	if (unlikely (sol_leff_alloc[sol / 8] & sol_get_bit (sol))
+		&& !flasher_leff_caller_p ())
+		return;
+
 	/* The duty cycle mask is only read by the IRQ
 	 * function, so it can be modified easily.
 	 * The timer value is read-and-decremented, so it
@@ -374,6 +409,33 @@ sol_stop (solnum_t sol)
 }
 
 
+/** Allocate a flasher to the running lamp effect.  Any pulse already
+in progress is stopped. */
+void flasher_leff_allocate (solnum_t sol)
+{
+	sol_stop (sol);
+	sol_leff_alloc[sol / 8] |= sol_get_bit (sol);
+}
+
+
+/** Allocate all flashers to the running lamp effect. */
+void flasher_leff_allocate_all (void)
+{
+	solnum_t sol;
+
+	for (sol = SOL_MIN_FLASHER; sol < PINIO_NUM_SOLS; sol++)
+		if (MACHINE_SOL_FLASHERP (sol))
+			flasher_leff_allocate (sol);
+}
+
+
+/** Free all flashers allocated by lamp effects. */
+void flasher_leff_free_all (void)
+{
+	memset (sol_leff_alloc, 0, SOL_REG_COUNT);
+}
+
+
 /** Initialize the solenoid subsystem. */
 void
 sol_init (void)
@@ -399,6 +461,10 @@ sol_init (void)
 
 	memset (sol_reg_readable, 0, SOL_REG_COUNT);
 
+	/* No flashers are allocated, and the full budget is available */
+	flasher_leff_free_all ();
+	sol_flash_budget = MACHINE_FLASHER_BUDGET;
+
 	/* Initialize the solenoid queue. */
 	queue_init (&sol_req_queue.header);
 }
@@ -32,21 +32,20 @@
  * consecutive readings at interrupt time, but needs to
  * be debounced further.
  *
- * This struct tracks the switch number, its state, and the
- * debounce timer.
+ * This struct tracks the switch number and the time at which
+ * its debounce period ends.
  *
- * There are a finite number of these objects.  When a change
- * is detected, we will either allocate a new slot or
- * re-use an existing slot for the same switch that did not
- * complete its previous debounce cycle.
+ * There are a finite number of these objects.  A switch that
+ * is already pending is not queued again until its previous
+ * debounce cycle completes.
  */
 typedef struct
 {
 	/* The switch number that is pending */
 	U8 id;
 
-	/* The amount of time left before the transition completes. */
-	S8 timer;
+	/* The system time at which the transition completes. */
+	U16 deadline;
 } pending_switch_t;
 
 
@@ -78,25 +77,32 @@ __fastram__ switch_bits_t sw_unstable;
  * see what the current state of a switch is. */
 __fastram__ switch_bits_t sw_logical;
 
+/** Nonzero for each switch column that has a bit set in sw_stable.
+ * The RTT sets these bits and switch_periodic clears them, so that
+ * columns without any activity are not scanned. */
+__fastram__ U8 sw_stable_cols[SWITCH_COLS_SIZE];
+
 /** Nonzero for each switch that is in the switch queue.
  * This is not strictly needed, but it provides a fast way to
  * see if a switch is already in the queue without having to
  * scan the entire array. */
 switch_bits_t sw_queued;
 
-/* An array of pending switches which have not fully debounced yet.
- * The array is kept compact, meaning that if there are N entries
- * used, they will always be in slots [0] to [N-1]. */
+/* A ring of pending switches which have not fully debounced yet.
+ * The entries are kept sorted by deadline, so the one at the head
+ * always completes first; servicing the queue only has to look there.
+ * Because most switches have similar debounce times, a new entry
+ * nearly always belongs at the tail. */
 pending_switch_t switch_queue[MAX_QUEUED_SWITCHES];
 
-/* A pointer to the first free entry in the switch queue.
- * When this is equal to 'switch_queue', it means the entire
- * queue is empty. */
-__fastram__ pending_switch_t *switch_queue_top;
+/* The index of the first entry in the switch queue */
+U8 switch_queue_head;
+
+/* The number of entries in the switch queue */
+U8 switch_queue_count;
 
-/** The last time that switch scanning occurred.  It is used
- * to determine by how much to decrement debounce timers. */
-U16 switch_last_service_time;
+#define switch_queue_entry(n) \
+	(&switch_queue[(switch_queue_head + (n)) % MAX_QUEUED_SWITCHES])
 
 /** The switch number of the last switch to be scheduled.
  * Provided as a convenience for test mode. */
@@ -229,6 +235,10 @@ void switch_sched_task (void)
 	const U8 sw = (U8)task_get_arg ();
 	const switch_info_t * const swinfo = switch_lookup (sw);
 
+#ifdef CONFIG_SWITCH_LATENCY
+	switch_latency_handler (sw);
+#endif
+
 	/* Ignore any switch that doesn't have a processing function.
 	   This shouldn't ever happen if things are working correctly, but it
 		was observed on PIC games when the PIC code is broken and reporting
@@ -380,99 +390,99 @@ void switch_transitioned (const U8 sw)
 		switch, if valid debounced transitions occur quickly. */
 		task_pid_t tp = task_create_gid (GID_SW_HANDLER, switch_sched_task);
 		task_set_arg (tp, sw);
+#ifdef CONFIG_SWITCH_LATENCY
+		switch_latency_dispatch (tp, sw);
+#endif
 	}
 }
 
 
-/** Add a new entry to the switch queue. */
+/** Add a new entry to the switch queue.  It is inserted in order
+ * of deadline, searching backwards from the tail. */
 void switch_queue_add (const switchnum_t sw)
 {
-	if (switch_queue_top < switch_queue + MAX_QUEUED_SWITCHES)
+	U16 deadline;
+	U8 n;
+
+	if (switch_queue_count < MAX_QUEUED_SWITCHES)
 	{
 		dbprintf ("adding %d to queue\n", sw);
-		switch_queue_top->id = sw;
-		switch_queue_top->timer = switch_lookup(sw)->debounce;
+		deadline = get_sys_time () + switch_lookup(sw)->debounce;
+		n = switch_queue_count;
+		while (n > 0 && (S16)(switch_queue_entry (n-1)->deadline - deadline) > 0)
+		{
+			*switch_queue_entry (n) = *switch_queue_entry (n-1);
+			n--;
+		}
+		switch_queue_entry (n)->id = sw;
+		switch_queue_entry (n)->deadline = deadline;
+		switch_queue_count++;
 		bit_on (sw_queued, sw);
-		switch_queue_top++;
 	}
 }
 
 
-/** Remove an entry from the switch queue */
-void switch_queue_remove (pending_switch_t *entry)
+/** Remove the entry at the head of the switch queue, and return
+ * its switch number */
+static U8 switch_queue_remove (void)
 {
-	/* Copy the last entry in the queue into the slot being deleted. */
-	dbprintf ("removing %d from queue\n", entry->id);
-	bit_off (sw_queued, entry->id);
-	entry->id = (switch_queue_top-1)->id;
-	entry->timer = (switch_queue_top-1)->timer;
-	switch_queue_top--;
+	U8 sw = switch_queue[switch_queue_head].id;
+
+	dbprintf ("removing %d from queue\n", sw);
+	bit_off (sw_queued, sw);
+	switch_queue_head = (switch_queue_head + 1) % MAX_QUEUED_SWITCHES;
+	switch_queue_count--;
+	return sw;
 }
 
 /** Initialize the switch queue */
 void switch_queue_init (void)
 {
-	switch_queue_top = switch_queue;
+	switch_queue_head = 0;
+	switch_queue_count = 0;
 	memset (sw_stable, 0, sizeof (sw_stable));
 	memset (sw_unstable, 0, sizeof (sw_unstable));
 	memset (sw_queued, 0, sizeof (sw_queued));
+	memset (sw_stable_cols, 0, sizeof (sw_stable_cols));
 }
 
 
 /** Service the switch queue.  This function is called
  * periodically to see if any pending switch transitions have
  * completed their debounce time.  If any switch becomes
- * unstable before the period expires, it will be removed
- * from the queue prior to this function being called.  So
- * all that is needed here is to decrement the timers, and if
- * one reaches zero, consider that switch transitioned.
+ * unstable before the period expires, it is noticed here,
+ * when its deadline is reached.  Because the queue is sorted,
+ * only the entries whose deadlines have passed are examined.
  */
 void switch_service_queue (void)
 {
-	pending_switch_t *entry;
-	U8 elapsed_time;
+	U8 sw;
 
-	/* See how long since the last time we serviced the queue.
-	This is in 16ms ticks. */
-	elapsed_time = get_elapsed_time (switch_last_service_time);
-
-	entry = switch_queue;
-	while (unlikely (entry < switch_queue_top))
+	while (unlikely (switch_queue_count != 0))
 	{
-		entry->timer -= elapsed_time;
-		if (entry->timer <= 0)
-		{
-			/* Debounce interval is complete. */
+		if ((S16)(get_sys_time () - switch_queue[switch_queue_head].deadline) < 0)
+			break;
 
-			/* See if the switch held its state during the debounce period */
-			if (bit_test (sw_unstable, entry->id))
-			{
-				/* Debouncing failed, so don't process the switch.
-				 * Restart IRQ-level scanning. */
-				rtt_disable ();
-				bit_off (sw_stable, entry->id);
-				bit_off (sw_unstable, entry->id);
-				rtt_enable ();
-			}
-			else
-			{
-				/* Debouncing succeeded, so process the switch */
-				switch_transitioned (entry->id);
-			}
+		/* Debounce interval is complete.  The queue entry can be
+		removed now. */
+		sw = switch_queue_remove ();
 
-			/* The queue entry can be removed now.
-			   Note we do not advance the 'entry' pointer in
-				this case, as we may have copied a legitimate
-				entry here. */
-			switch_queue_remove (entry);
+		/* See if the switch held its state during the debounce period */
+		if (bit_test (sw_unstable, sw))
+		{
+			/* Debouncing failed, so don't process the switch.
+			 * Restart IRQ-level scanning. */
+			rtt_disable ();
+			bit_off (sw_stable, sw);
+			bit_off (sw_unstable, sw);
+			rtt_enable ();
 		}
 		else
 		{
-			entry++;
+			/* Debouncing succeeded, so process the switch */
+			switch_transitioned (sw);
 		}
 	}
-
-	switch_last_service_time = get_sys_time ();
 }
 
 
@@ -489,14 +499,18 @@ static inline void switch_matrix_dump (const char *name, U8 *matrix)
 
 void switch_queue_dump (void)
 {
-	pending_switch_t *entry = switch_queue;
+	U8 n;
 
-	dbprintf ("Switch queue base: %p\n", switch_queue);
-	dbprintf ("Switch queue top: %p\n", switch_queue_top);
-	while (entry != switch_queue_top)
+	dbprintf ("Switch queue head: %d\n", switch_queue_head);
+	dbprintf ("Switch queue count: %d\n", switch_queue_count);
+	for (n = 0; n < switch_queue_count; n++)
 	{
-		dbprintf ("Pending: SW%d  %d\n", entry->id, entry->timer);
-		entry++;
+		pending_switch_t *entry = switch_queue_entry (n);
+		S16 remaining = entry->deadline - get_sys_time ();
+		if (remaining < 0)
+			dbprintf ("Pending: SW%d  overdue\n", entry->id);
+		else
+			dbprintf ("Pending: SW%d  %ld\n", entry->id, (U16)remaining);
 	}
 	switch_matrix_dump ("Raw     ", sw_raw);
 	switch_matrix_dump ("Logical ", sw_logical);
@@ -534,9 +548,12 @@ static void switch_update_stable (const U8 sw)
  */
 void switch_periodic (void)
 {
-	register U16 col = 0;
 	extern U8 sys_init_complete;
+	U8 cols[SWITCH_COLS_SIZE];
+	U8 colbyte;
+	U8 col;
 	U8 rows;
+	U8 sw;
 
 	/* If there are row/column shorts, ignore the switch matrix. */
 	if (unlikely (sw_short_timer))
@@ -565,23 +582,38 @@ void switch_periodic (void)
 	 * even if there are hardware errors. */
 	switch_service_queue ();
 
-	/* Iterate over each switch column to see what needs to be done. */
+	/* Take the set of columns that the RTT has marked since the last
+	call.  Any column marked after this will be seen next time. */
+	rtt_disable ();
+	for (colbyte = 0; colbyte < SWITCH_COLS_SIZE; colbyte++)
+	{
+		cols[colbyte] = sw_stable_cols[colbyte];
+		sw_stable_cols[colbyte] = 0;
+	}
+	rtt_enable ();
+
+	/* Iterate over only the marked switch columns to see what needs
+	to be done. */
 	task_dispatching_ok = TRUE;
-	for (col=0; col < SWITCH_BITS_SIZE; col++)
+	for (colbyte = 0; colbyte < SWITCH_COLS_SIZE; colbyte++)
 	{
-		/* Each bit in sw_stable indicates a switch
-		that just transitioned and may need to be processed */
-		if (unlikely (rows = sw_stable[col]))
+		while (unlikely (cols[colbyte]))
 		{
-			U8 sw = col * 8;
-			do {
-				if ((rows & 1) && !bit_test (sw_queued, sw))
-					switch_update_stable (sw);
-				rows >>= 1;
-				sw++;
-			} while (rows);
+			col = colbyte * 8 + low_bit_number (cols[colbyte]);
+			cols[colbyte] &= cols[colbyte] - 1;
+
+			/* Each bit in sw_stable indicates a switch
+			that just transitioned and may need to be processed.
+			Those already in the debounce queue are skipped. */
+			rows = sw_stable[col] & ~sw_queued[col];
+			while (rows)
+			{
+				sw = col * 8 + low_bit_number (rows);
+				rows &= rows - 1;
+				switch_update_stable (sw);
+			}
+			task_runs_long ();
 		}
-		task_runs_long ();
 	}
 }
 
@@ -612,15 +644,6 @@ CALLSET_ENTRY (switch, diagnostic_check)
 }
 
 
-/** Do final initializing once system init is complete. */
-CALLSET_ENTRY (switch, init_complete)
-{
-	/* Initialize the service timer.  This needs to happen
-	 * just before interrupts are enabled */
-	switch_last_service_time = get_sys_time ();
-}
-
-
 /** Once per second, see if we had disabled switch scanning
  * due to a short, and it should be reenabled now.  This
  * is not accurately timed: it may range from 2.1 to 3s of
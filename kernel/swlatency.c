@@ -0,0 +1,190 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Switch latency statistics.
+ *
+ * When CONFIG_SWITCH_LATENCY is enabled, every scheduled switch event is
+ * timed at three points: when the switch RTT first sees it stable, when
+ * switch_transitioned() starts a task for it, and when that task begins
+ * running in switch_sched_task().  The times are kept in the class data
+ * of each task, so that several tasks pending for the same switch are
+ * each measured from when they were started.  The first interval (the queue time)
+ * includes any extra debounce time that the switch requires; the second
+ * (the task time) is the delay in getting the handler scheduled.
+ *
+ * The clock is the number of switch RTT invocations, so it has a
+ * resolution of SW_LATENCY_MS_PER_TICK.  Per-switch results can be
+ * viewed from the development menu in test mode, or dumped to the
+ * debugger with switch_latency_dump().
+ */
+
+#include <freewpc.h>
+#include <printf.h>
+
+/** The latency clock.  This is incremented by the switch RTT. */
+__fastram__ U16 sw_latency_clock;
+
+/** The value of the latency clock when each switch became stable */
+U16 sw_latency_edge_time[NUM_SWITCHES];
+
+/** The statistics for each switch */
+struct switch_latency sw_latency_stats[NUM_SWITCHES];
+
+
+/** Convert a clock difference to a latency value, saturating at
+ * the largest value that fits in a byte. */
+static U8 switch_latency_ticks (U16 start)
+{
+	U16 ticks = sw_latency_clock - start;
+	return (ticks > 0xFF) ? 0xFF : ticks;
+}
+
+
+/** Return the histogram bucket for a total latency.  Bucket 0 holds
+ * latencies under 1 tick; bucket N holds latencies from 2^(N-1) ticks
+ * up to but not including 2^N ticks; the last bucket holds the rest. */
+static U8 switch_latency_bucket (U8 ticks)
+{
+	U8 bucket = 0;
+	while (ticks && bucket < SW_LATENCY_BUCKETS-1)
+	{
+		ticks >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+
+/** Called by switch_transitioned() when the task TP is started to
+ * handle a switch. */
+void switch_latency_dispatch (task_pid_t tp, const U8 sw)
+{
+	struct switch_latency_stamp *stamp =
+		task_init_class_data (tp, struct switch_latency_stamp);
+
+	rtt_disable ();
+	stamp->queue_ticks = switch_latency_ticks (sw_latency_edge_time[sw]);
+	stamp->sched_time = sw_latency_clock;
+	rtt_enable ();
+}
+
+
+/** Called by switch_sched_task() when the handler for a switch begins
+ * running.  This updates the statistics for the switch. */
+void switch_latency_handler (const U8 sw)
+{
+	struct switch_latency *lat = &sw_latency_stats[sw];
+	const struct switch_latency_stamp *stamp =
+		task_current_class_data (struct switch_latency_stamp);
+	U8 queue_ticks = stamp->queue_ticks;
+	U8 task_ticks;
+	U16 total;
+	U8 n;
+
+	rtt_disable ();
+	task_ticks = switch_latency_ticks (stamp->sched_time);
+	rtt_enable ();
+
+	total = queue_ticks + task_ticks;
+	if (total > 0xFF)
+		total = 0xFF;
+
+	if (lat->count == 0 || total < lat->min)
+		lat->min = total;
+	if (total > lat->max)
+		lat->max = total;
+	if (queue_ticks > lat->queue_max)
+		lat->queue_max = queue_ticks;
+	if (task_ticks > lat->task_max)
+		lat->task_max = task_ticks;
+
+	/* Keep the running total from overflowing by halving it along
+	with the count; the average is unchanged. */
+	if (lat->count == 0xFFFF || (U16)(lat->sum + total) < lat->sum)
+	{
+		lat->count /= 2;
+		lat->sum /= 2;
+	}
+	lat->count++;
+	lat->sum += total;
+
+	/* Likewise, when a bucket fills up, halve all of them so that
+	the shape of the histogram is kept. */
+	n = switch_latency_bucket (total);
+	if (lat->buckets[n] == 0xFF)
+	{
+		U8 i;
+		for (i=0; i < SW_LATENCY_BUCKETS; i++)
+			lat->buckets[i] /= 2;
+	}
+	lat->buckets[n]++;
+}
+
+
+/** Return the average total latency of a switch, in ticks */
+U8 switch_latency_average (const U8 sw)
+{
+	const struct switch_latency *lat = &sw_latency_stats[sw];
+	if (lat->count == 0)
+		return 0;
+	return lat->sum / lat->count;
+}
+
+
+/** Clear all of the latency statistics */
+void switch_latency_reset (void)
+{
+	memset (sw_latency_stats, 0, sizeof (sw_latency_stats));
+}
+
+
+#ifdef DEBUGGER
+void switch_latency_dump (void)
+{
+	U8 sw;
+	U8 n;
+
+	dbprintf ("Latency (ms): N min/avg/max Q T hist\n");
+	for (sw = 0; sw < NUM_SWITCHES; sw++)
+	{
+		const struct switch_latency *lat = &sw_latency_stats[sw];
+		if (lat->count == 0)
+			continue;
+		dbprintf ("SW%d: %ld %ld/%ld/%ld %ld %ld ", sw, lat->count,
+			(U16)lat->min * SW_LATENCY_MS_PER_TICK,
+			(U16)switch_latency_average (sw) * SW_LATENCY_MS_PER_TICK,
+			(U16)lat->max * SW_LATENCY_MS_PER_TICK,
+			(U16)lat->queue_max * SW_LATENCY_MS_PER_TICK,
+			(U16)lat->task_max * SW_LATENCY_MS_PER_TICK);
+		for (n = 0; n < SW_LATENCY_BUCKETS; n++)
+			dbprintf (" %d", lat->buckets[n]);
+		dbprintf ("\n");
+		task_runs_long ();
+	}
+}
+#endif /* DEBUGGER */
+
+
+CALLSET_ENTRY (switch_latency, init)
+{
+	switch_latency_reset ();
+}
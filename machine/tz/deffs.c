@@ -69,7 +69,11 @@ void extra_ball_deff (void)
 	U16 fno;
 	for (fno = IMG_EBALL_START; fno <= IMG_EBALL_END; fno += 2)
 	{
-		dmd_alloc_pair ();
+		/* A delta frame is drawn on top of the previous one */
+		if (frame_is_delta (fno))
+			dmd_dup_mapped ();
+		else
+			dmd_alloc_pair ();
 		frame_draw (fno);
 		dmd_show2 ();
 		task_sleep (TIME_66MS);
@@ -86,7 +90,11 @@ void driver_deff (void)
 	{
 		for (fno = IMG_DRIVER_START; fno <= IMG_DRIVER_END; fno += 2)
 		{
-			dmd_alloc_pair ();
+			/* A delta frame is drawn on top of the previous one */
+			if (frame_is_delta (fno))
+				dmd_dup_mapped ();
+			else
+				dmd_alloc_pair ();
 			frame_draw (fno);
 			dmd_show2 ();
 			task_sleep (TIME_66MS);
@@ -49,49 +49,42 @@ void gi_cycle_leff (void)
 	gi_leff_enable (PINIO_GI_STRINGS);
 }
 
-void flasher_happy_leff (void)
-{
-	U8 i;
-	for (i=0; i < 8; i++)
-	{
-		flasher_pulse (FLASH_CLOCK_TARGET);
-		flasher_pulse (FLASH_RAMP1);
-		flasher_pulse (FLASH_GUMBALL_HIGH);
-		task_sleep (TIME_100MS);
-
-		flasher_pulse (FLASH_RAMP2);
-		flasher_pulse (FLASH_GUMBALL_MID);
-		task_sleep (TIME_100MS);
-
-		flasher_pulse (FLASH_GUMBALL_LOW);
-		flasher_pulse (FLASH_RAMP3_POWER_PAYOFF);
-		task_sleep (TIME_100MS);
-	}
-	leff_exit ();
-}
-
-void left_ramp_leff (void)
-{
-	U8 i;
-	for (i=0; i < 4; i++)
-	{
-		flasher_pulse (FLASH_RAMP1);
-		task_sleep (TIME_100MS);
-		flasher_pulse (FLASH_RAMP2);
-		task_sleep (TIME_100MS);
-		flasher_pulse (FLASH_RAMP3_POWER_PAYOFF);
-		task_sleep (TIME_100MS * 2);
-	}
-	leff_exit ();
-}
-
-void no_gi_leff (void)
-{
-	gi_leff_disable (PINIO_GI_STRINGS);
-	task_sleep_sec (2);
-	gi_leff_enable (PINIO_GI_STRINGS);
-	leff_exit ();
-}
+const U8 flasher_happy_leff[] = {
+	LEFF_LOOP (8),
+		LEFF_FLASH (FLASH_CLOCK_TARGET),
+		LEFF_FLASH (FLASH_RAMP1),
+		LEFF_FLASH (FLASH_GUMBALL_HIGH),
+		LEFF_SLEEP (TIME_100MS),
+
+		LEFF_FLASH (FLASH_RAMP2),
+		LEFF_FLASH (FLASH_GUMBALL_MID),
+		LEFF_SLEEP (TIME_100MS),
+
+		LEFF_FLASH (FLASH_GUMBALL_LOW),
+		LEFF_FLASH (FLASH_RAMP3_POWER_PAYOFF),
+		LEFF_SLEEP (TIME_100MS),
+	LEFF_NEXT,
+	LEFF_END
+};
+
+const U8 left_ramp_leff[] = {
+	LEFF_LOOP (4),
+		LEFF_FLASH (FLASH_RAMP1),
+		LEFF_SLEEP (TIME_100MS),
+		LEFF_FLASH (FLASH_RAMP2),
+		LEFF_SLEEP (TIME_100MS),
+		LEFF_FLASH (FLASH_RAMP3_POWER_PAYOFF),
+		LEFF_SLEEP (TIME_200MS),
+	LEFF_NEXT,
+	LEFF_END
+};
+
+const U8 no_gi_leff[] = {
+	LEFF_GI_OFF (PINIO_GI_STRINGS),
+	LEFF_SLEEP (TIME_2S),
+	LEFF_GI_ON (PINIO_GI_STRINGS),
+	LEFF_END
+};
 
 void turn_on_gi_leff (void)
 {
@@ -175,47 +168,39 @@ void clock_target_leff (void)
 }
 
 
-void game_timeout_leff (void)
-{
-	U8 i;
-	for (i=0; i < 3; i++)
-	{
-		task_sleep (TIME_500MS);
-		gi_leff_enable (GI_POWERFIELD+GI_CLOCK);
-		task_sleep (TIME_100MS);
-		gi_leff_disable (GI_POWERFIELD+GI_CLOCK);
-	}
-	gi_leff_enable (GI_POWERFIELD+GI_CLOCK);
-	leff_exit ();
-}
-
-void clock_round_started_leff (void)
-{
-	U8 i;
-	for (i=0; i < 3; i++)
-	{
-		gi_leff_enable (GI_CLOCK);
-		task_sleep (TIME_100MS);
-		gi_leff_disable (GI_CLOCK);
-		task_sleep (TIME_200MS);
-	}
-	gi_leff_enable (GI_CLOCK);
-	leff_exit ();
-}
-
-void multiball_running_leff (void)
-{
-	leff_on (LM_GUM);
-	leff_off (LM_BALL);
-	leff_off (LM_LOCK1);
-	leff_on (LM_LOCK2);
-	for (;;)
-	{
-		lamplist_apply (LAMPLIST_DOOR_LOCKS_AND_GUMBALL, leff_toggle);
-		task_sleep (TIME_200MS);
-	}
-	leff_exit ();
-}
+const U8 game_timeout_leff[] = {
+	LEFF_LOOP (3),
+		LEFF_SLEEP (TIME_500MS),
+		LEFF_GI_ON (GI_POWERFIELD+GI_CLOCK),
+		LEFF_SLEEP (TIME_100MS),
+		LEFF_GI_OFF (GI_POWERFIELD+GI_CLOCK),
+	LEFF_NEXT,
+	LEFF_GI_ON (GI_POWERFIELD+GI_CLOCK),
+	LEFF_END
+};
+
+const U8 clock_round_started_leff[] = {
+	LEFF_LOOP (3),
+		LEFF_GI_ON (GI_CLOCK),
+		LEFF_SLEEP (TIME_100MS),
+		LEFF_GI_OFF (GI_CLOCK),
+		LEFF_SLEEP (TIME_200MS),
+	LEFF_NEXT,
+	LEFF_GI_ON (GI_CLOCK),
+	LEFF_END
+};
+
+const U8 multiball_running_leff[] = {
+	LEFF_ON (LM_GUM),
+	LEFF_OFF (LM_BALL),
+	LEFF_OFF (LM_LOCK1),
+	LEFF_ON (LM_LOCK2),
+	LEFF_FOREVER,
+		LEFF_APPLY (LAMPLIST_DOOR_LOCKS_AND_GUMBALL, TOGGLE),
+		LEFF_SLEEP (TIME_200MS),
+	LEFF_NEXT,
+	LEFF_END
+};
 
 static void pf_strobe_down_subtask (void)
 {
@@ -332,21 +317,17 @@ void door_strobe_leff (void)
 	leff_exit ();
 }
 
-void right_loop_leff (void)
-{
-	lamplist_set_apply_delay (TIME_16MS);
-	lamplist_apply (LAMPLIST_SORT4, leff_toggle);
-	lamplist_apply (LAMPLIST_SORT4, leff_toggle);
-	leff_exit ();
-}
+const U8 right_loop_leff[] = {
+	LEFF_WALK (LAMPLIST_SORT4, TOGGLE, TIME_16MS),
+	LEFF_WALK (LAMPLIST_SORT4, TOGGLE, TIME_16MS),
+	LEFF_END
+};
 
-void left_loop_leff (void)
-{
-	lamplist_set_apply_delay (TIME_16MS);
-	lamplist_apply (LAMPLIST_SORT3, leff_toggle);
-	lamplist_apply (LAMPLIST_SORT3, leff_toggle);
-	leff_exit ();
-}
+const U8 left_loop_leff[] = {
+	LEFF_WALK (LAMPLIST_SORT3, TOGGLE, TIME_16MS),
+	LEFF_WALK (LAMPLIST_SORT3, TOGGLE, TIME_16MS),
+	LEFF_END
+};
 
 void jets_active_leff (void)
 {
@@ -356,13 +337,11 @@ void jets_active_leff (void)
 	leff_exit ();
 }
 
-void circle_out_leff (void)
-{
-	lamplist_set_apply_delay (TIME_33MS);
-	lamplist_apply (LAMPLIST_CIRCLE_OUT, leff_toggle);
-	lamplist_apply (LAMPLIST_CIRCLE_OUT, leff_toggle);
-	leff_exit ();
-}
+const U8 circle_out_leff[] = {
+	LEFF_WALK (LAMPLIST_CIRCLE_OUT, TOGGLE, TIME_33MS),
+	LEFF_WALK (LAMPLIST_CIRCLE_OUT, TOGGLE, TIME_33MS),
+	LEFF_END
+};
 
 void color_cycle_leff (void)
 {
@@ -477,25 +456,23 @@ void mpf_active_leff (void)
 	leff_exit ();
 }
 
-void mpf_hit_leff (void)
-{
-	U8 i = 5;
-	do {
-		gi_leff_disable (GI_POWERFIELD);
-		task_sleep (TIME_66MS);
-		flasher_pulse (FLASH_POWERFIELD);
-		task_sleep (TIME_33MS);
-		flasher_pulse (FLASH_POWERFIELD);
-		task_sleep (TIME_33MS);
-		flasher_pulse (FLASH_POWERFIELD);
-		task_sleep (TIME_33MS);
-		gi_leff_enable (GI_POWERFIELD);
-		task_sleep (TIME_66MS);
-		flasher_pulse (FLASH_POWERFIELD);
-		task_sleep (TIME_33MS);
-	} while (--i != 0);
-	leff_exit ();
-}
+const U8 mpf_hit_leff[] = {
+	LEFF_LOOP (5),
+		LEFF_GI_OFF (GI_POWERFIELD),
+		LEFF_SLEEP (TIME_66MS),
+		LEFF_FLASH (FLASH_POWERFIELD),
+		LEFF_SLEEP (TIME_33MS),
+		LEFF_FLASH (FLASH_POWERFIELD),
+		LEFF_SLEEP (TIME_33MS),
+		LEFF_FLASH (FLASH_POWERFIELD),
+		LEFF_SLEEP (TIME_33MS),
+		LEFF_GI_ON (GI_POWERFIELD),
+		LEFF_SLEEP (TIME_66MS),
+		LEFF_FLASH (FLASH_POWERFIELD),
+		LEFF_SLEEP (TIME_33MS),
+	LEFF_NEXT,
+	LEFF_END
+};
 
 void spiralaward_leff (void)
 {
@@ -507,16 +484,13 @@ void spiralaward_leff (void)
 	leff_exit ();
 }
 
-void flash_gi_leff (void)
-{
-	U8 i;
-	for (i = 1; i < 7; i++)
-	{
-		gi_leff_disable (PINIO_GI_STRINGS);
-		task_sleep (TIME_100MS);
-		gi_leff_enable (PINIO_GI_STRINGS);
-		task_sleep (TIME_100MS);
-	}
-	gi_leff_enable (PINIO_GI_STRINGS);
-	leff_exit ();
-}
+const U8 flash_gi_leff[] = {
+	LEFF_LOOP (6),
+		LEFF_GI_OFF (PINIO_GI_STRINGS),
+		LEFF_SLEEP (TIME_100MS),
+		LEFF_GI_ON (PINIO_GI_STRINGS),
+		LEFF_SLEEP (TIME_100MS),
+	LEFF_NEXT,
+	LEFF_GI_ON (PINIO_GI_STRINGS),
+	LEFF_END
+};
@@ -75,8 +75,12 @@ void show_driver_animation (void)
 	{
 		for (fno = IMG_DRIVER_START; fno <= IMG_DRIVER_END; fno += 2)
 		{
-			/* We are drawing a full frame, so a clean isn't needed */
-			dmd_alloc_pair ();
+			/* A delta frame is drawn on top of the previous one;
+			anything else covers the whole page */
+			if (frame_is_delta (fno))
+				dmd_dup_mapped ();
+			else
+				dmd_alloc_pair ();
 			frame_draw (fno);
 			dmd_show2 ();
 			task_sleep (TIME_66MS);
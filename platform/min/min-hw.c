@@ -55,6 +55,7 @@ U8 readb (IOPTR ptr)
 /* RTT(name=switch_rtt freq=2) */
 void switch_rtt (void)
 {
+	platform_switch_latency_tick ();
 	platform_switch_input (0, readb (IO_SWITCH));
 	platform_switch_debounce (0);
 #ifndef CONFIG_SIM
@@ -19,6 +19,7 @@
  */
 
 #include <freewpc.h>
+#include <system/platform.h>
 #include "native/log.h"
 
 void proc_debug_write (U8 c)
@@ -31,8 +32,10 @@ void proc_debug_write (U8 c)
  */
 void proc_post_switch_transition (switchnum_t swno)
 {
-	extern __fastram__ switch_bits_t sw_stable;
+	U8 prev = sw_stable[SW_COL (swno)];
 	bit_toggle (sw_stable, swno);
+	bit_on (sw_stable_cols, SW_COL (swno));
+	platform_switch_latency_stamp (SW_COL (swno), prev);
 }
 
 
@@ -51,6 +54,7 @@ U8 readb (IOPTR addr)
 /* RTT(name=switch_rtt freq=2) */
 void switch_rtt (void)
 {
+	platform_switch_latency_tick ();
 }
 
 /* RTT(name=lamp_rtt freq=16) */
@@ -250,3 +250,46 @@ sparse_done:
 	puls	u,pc
 
 
+	;--------------------------------------------------------
+	;
+	; void frame_decode_delta_asm (void *src);
+	;
+	; X = pointer to source image data
+	;
+	;--------------------------------------------------------
+	; A delta image holds only the words that changed since the
+	; previous frame, which must already be in the low page.  It
+	; uses the same <len, move, data[]> blocks as a sparse image,
+	; but the data is XORed onto the page, and the page is not
+	; cleared first.
+	.globl _frame_decode_delta_asm
+_frame_decode_delta_asm:
+	pshs	u
+	ldu	#DMD_LOW_BASE
+
+delta_loop:
+	; First byte is the count of changed words.
+	; If zero, this means no more blocks
+	lda	,x+
+	beq	delta_done
+	sta	*m0
+
+	; Second byte is the number of unchanged bytes to skip
+	ldb	,x+
+	leau	b,u
+
+delta_block_loop:
+	ldd	,x++
+	eora	,u
+	eorb	1,u
+	std	,u++
+	dec	*m0
+	bne	delta_block_loop
+
+	; On to the next block
+	bra	delta_loop
+
+delta_done:
+	puls	u,pc
+
+
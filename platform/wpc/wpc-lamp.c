@@ -42,6 +42,24 @@ void lamp_rtt (void)
 	pinio_write_lamp_data (bits);
 	pinio_write_lamp_strobe (lamp_strobe_mask);
 
+#ifdef CONFIG_LAMP_STROBE_SCHEDULE
+	/* Advance to the next slot in the strobe schedule.  The schedule is
+	generated from the machine description; it skips columns that have no
+	lamps, and strobes some columns twice per frame, so that they are
+	refreshed more often at no extra cost per strobe. */
+	if (++lamp_strobe_slot == MACHINE_LAMP_STROBE_SLOTS)
+	{
+		lamp_strobe_slot = 0;
+
+		/* After strobing all lamps, reload the power saver timer */
+		lamp_power_timer = lamp_power_level;
+#ifdef CONFIG_LAMP_FADE
+		lamp_fade_next_plane ();
+#endif
+	}
+	lamp_strobe_column = lamp_strobe_schedule[lamp_strobe_slot];
+	lamp_strobe_mask = single_bit_set (lamp_strobe_column);
+#else
 	/* Advance the strobe value for the next iteration.
 	Keep this together with the above so that lamp_strobe_mask
 	is already in a register. */
@@ -54,12 +72,16 @@ void lamp_rtt (void)
 
 		/* After strobing all lamps, reload the power saver timer */
 		lamp_power_timer = lamp_power_level;
+#ifdef CONFIG_LAMP_FADE
+		lamp_fade_next_plane ();
+#endif
 	}
 	else
 	{
 		/* Advance strobe to next position for next iteration */
 		lamp_strobe_column++;
 	}
+#endif /* CONFIG_LAMP_STROBE_SCHEDULE */
 }
 
 
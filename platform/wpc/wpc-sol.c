@@ -4,16 +4,23 @@
 
 /** Return 0 if the given solenoid/flasher should be off,
 else return the bitmask that reflects that solenoid's
-position in the output register. */
+position in the output register.  A flasher that should be on, but
+would exceed the flasher budget, stays off and keeps its time for the
+next slot. */
 extern inline U8 platform_sol_timer_check (const U8 id)
 {
 	if (MACHINE_SOL_FLASHERP (id))
 		if (likely (sol_timers[id - SOL_MIN_FLASHER] != 0))
 		{
-			sol_timers[id - SOL_MIN_FLASHER]--;
-
 			if (likely (sol_duty_state[id - SOL_MIN_FLASHER] & sol_duty_mask))
+			{
+				if (unlikely (sol_flash_budget == 0))
+					return 0;
+				sol_flash_budget--;
+				sol_timers[id - SOL_MIN_FLASHER]--;
 				return 1;
+			}
+			sol_timers[id - SOL_MIN_FLASHER]--;
 		}
 	return 0;
 }
@@ -109,6 +116,10 @@ void sol_update_rtt_1 (void)
 	sol_duty_mask <<= 1;
 	if (sol_duty_mask == 0)
 		sol_duty_mask = 1;
+
+	/* All of the flashers have been updated for this slot, so the
+	 * budget starts over. */
+	sol_flash_budget = MACHINE_FLASHER_BUDGET;
 }
 
 
@@ -38,7 +38,9 @@ void pic_rtt_unlock (void)
 #endif
 
 
-#if defined(CONFIG_PLATFORM_WPC) && defined(__m6809__)
+/* The optimized version is not used when measuring switch latency,
+as it has no place to save the previous stable bits. */
+#if defined(CONFIG_PLATFORM_WPC) && defined(__m6809__) && !defined(CONFIG_SWITCH_LATENCY)
 extern inline void switch_rowpoll (const U8 col)
 {
 	/* Load the raw switch value from the hardware. */
@@ -106,6 +108,8 @@ extern inline void switch_rowpoll (const U8 col)
 			"\tsta	%3" ::
 				"m" (sw_logical[col]), "m" (sw_edge[col]),
 				"m" (sw_stable[col]), "m" (sw_unstable[col]) );
+
+	platform_switch_mark_stable (col);
 }
 
 #else /* !__m6809__ */
@@ -119,6 +123,7 @@ extern inline void switch_rowpoll (const U8 col)
  */
 extern inline void switch_rowpoll (const U8 col)
 {
+	U8 prev = sw_stable[col];
 	U8 edge;
 
 	/*
@@ -141,6 +146,8 @@ extern inline void switch_rowpoll (const U8 col)
 	sw_stable[col] |= edge & sw_edge[col];
 	sw_unstable[col] |= ~edge & sw_stable[col];
 	sw_edge[col] = edge;
+	platform_switch_latency_stamp (col, prev);
+	platform_switch_mark_stable (col);
 }
 
 #endif
@@ -150,6 +157,7 @@ extern inline void switch_rowpoll (const U8 col)
 /* RTT(name=switch_rtt freq=2) */
 void switch_rtt (void)
 {
+	platform_switch_latency_tick ();
 	switch_rowpoll (0);
 	if (switch_scanning_ok ())
 	{
@@ -22,6 +22,10 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <termios.h>
+#ifdef CONFIG_UCONTEXT
+#include <poll.h>
+#include <unistd.h>
+#endif
 #include <freewpc.h>
 #include <simulation.h>
 
@@ -114,8 +118,21 @@ void sim_key_install_shooter (char key)
 static char sim_getchar (void)
 {
 	char inbuf;
-#ifdef CONFIG_PTH
+#if defined(CONFIG_PTH)
 	ssize_t res = pth_read (sim_input_fd, &inbuf, 1);
+#elif defined(CONFIG_UCONTEXT)
+	/* All tasks share one OS thread, so do not block waiting for
+	input.  Return a null character, which is ignored, if none
+	is available. */
+	struct pollfd pfd = { .fd = sim_input_fd, .events = POLLIN };
+	ssize_t res;
+
+	if (poll (&pfd, 1, 0) == 0)
+	{
+		task_sleep (TIME_16MS);
+		return '\0';
+	}
+	res = read (sim_input_fd, &inbuf, 1);
 #else
 	ssize_t res = read (sim_input_fd, &inbuf, 1);
 #endif
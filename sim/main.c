@@ -43,7 +43,8 @@ extern void exit (int);
 /** The actual time at which the simulation was started */
 static time_t sim_boot_time;
 
-/** The rate at which the simulated clock should run */
+/** The rate at which the simulated clock should run.  With the ucontext
+scheduler, zero means to run as fast as possible (turbo mode). */
 int linux_irq_multiplier = 1;
 
 /** When nonzero, the system is held in reset afer power on.  This lets
@@ -132,8 +133,14 @@ __noreturn__ void sim_exit (U8 error_code)
 unsigned int
 sim_get_wall_clock (void)
 {
+#ifdef CONFIG_UCONTEXT
+	/* The simulated clock may run at any speed, so derive the wall
+	clock from it and not from the host. */
+	return realtime_read () / 60000UL;
+#else
 	time_t now = time (NULL);
 	return ((now - sim_boot_time) * linux_irq_multiplier) / 60;
+#endif
 }
 
 
@@ -177,6 +184,10 @@ int main (int argc, char *argv[])
 			printf ("-o <file>           Log debug messages to file (default : stdout)\n");
 			printf ("--debuginit         Wait for GDB attach during init (default: no)\n");
 			printf ("--exec <file>       Read script commands from file\n");
+#ifdef CONFIG_UCONTEXT
+			printf ("--speed <n>         Run the clock n times faster than realtime (default: 1)\n");
+			printf ("--turbo             Run the clock as fast as possible (default: no)\n");
+#endif
 			exit (0);
 		}
 		else if (!strcmp (arg, "-f"))
@@ -208,6 +219,16 @@ int main (int argc, char *argv[])
 		{
 			crash_on_error = 1;
 		}
+#ifdef CONFIG_UCONTEXT
+		else if (!strcmp (arg, "--speed"))
+		{
+			linux_irq_multiplier = strtoul (argv[argn++], NULL, 0);
+		}
+		else if (!strcmp (arg, "--turbo"))
+		{
+			linux_irq_multiplier = 0;
+		}
+#endif
 		else if (strchr (arg, '='))
 		{
 			char varval[64];
@@ -20,6 +20,7 @@
 
 #include <freewpc.h>
 #include <simulation.h>
+#include <interrupt.h>
 #include <ctype.h>
 
 const char *tlast = NULL;
@@ -286,6 +287,11 @@ void exec_script (char *cmd)
 			t = tnext ();
 			signal_capture_set_file (t);
 		}
+		else if (teq (t, "format"))
+		{
+			t = tnext ();
+			signal_capture_set_binary (teq (t, "binary"));
+		}
 		else if (teq (t, "add"))
 		{
 			signal_capture_add (tsigno ());
@@ -372,6 +378,27 @@ void exec_script (char *cmd)
 		} while (--v > 0);
 		simlog (SLC_DEBUG, "Awake again.", v);
 	}
+#if defined(CONFIG_SWITCH_LATENCY) && defined(DEBUGGER)
+	/*********** swlatency ***************/
+	else if (teq (t, "swlatency"))
+	{
+		switch_latency_dump ();
+	}
+#endif
+#if defined(CONFIG_SCHED_PROFILE) && defined(DEBUGGER)
+	/*********** rttprof ***************/
+	else if (teq (t, "rttprof"))
+	{
+		rtt_profile_dump ();
+	}
+#endif
+#if defined(CONFIG_CALLSET_PROFILE) && defined(DEBUGGER)
+	/*********** csprof ***************/
+	else if (teq (t, "csprof"))
+	{
+		callset_profile_dump ();
+	}
+#endif
 	/*********** exit ***************/
 	else if (teq (t, "exit"))
 	{
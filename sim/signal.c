@@ -22,6 +22,7 @@
 #include <simulation.h>
 #include <stdint.h>
 #include <math.h>
+#include <hwsim/sigfile.h>
 
 
 /**
@@ -32,7 +33,15 @@
 
 #define MAX_READINGS 256
 #define MAX_CAPTURES 16
-#define MAX_EXPR 8
+
+/** The maximum number of instructions in a compiled trigger */
+#define MAX_TRIGGER_INSNS 32
+
+/** The value of sig_changed when no signal has changed, only time */
+#define SIGNO_UNCHANGED 0xFFFFFFFFUL
+
+/** The size of the stdio buffer for the capture file */
+#define CAPTURE_BUFFER_SIZE (64 * 1024)
 
 /**
  * A structure for tracking a single binary signal over a period
@@ -61,6 +70,12 @@ typedef struct signal_readings
  */
 signal_readings_t *signal_readings[MAX_SIGNALS] = { NULL, };
 
+/**
+ * The last chunk in each signal's list, which is where new readings
+ * are added.
+ */
+signal_readings_t *signal_readings_tail[MAX_SIGNALS] = { NULL, };
+
 /**
  * The last known value of each signal.  This does not
  * provide any history.  Each signal is stored as a single bit.
@@ -74,7 +89,67 @@ uint32_t signals_being_captured[MAX_CAPTURES];
 /** The output file when capturing is enabled */
 FILE *signal_capture_file;
 
-signal_expression_t *signal_start_expr, *signal_stop_expr;
+/** Nonzero if the capture file is written in the binary format
+ * described in hwsim/sigfile.h, rather than as text */
+int signal_capture_binary = 0;
+
+/** For binary captures, the signals in each column of the file,
+ * fixed when the capture starts */
+uint32_t signal_capture_columns[MAX_CAPTURES];
+unsigned int signal_capture_column_count;
+
+/** For binary captures, the values last written for each column */
+double signal_capture_values[MAX_CAPTURES];
+
+/** For binary captures, the time of the last record written */
+simulated_time_interval_t signal_capture_last_time;
+
+/**
+ * The instructions in a compiled trigger expression.  A trigger is
+ * evaluated as a stack machine, with each instruction pushing a value
+ * or combining the top values on the stack.
+ */
+enum signal_insn_op
+{
+	INSN_FALSE,
+	INSN_CHANGED,
+	INSN_EQ,
+	INSN_TIME,
+	INSN_TIMEDIFF,
+	INSN_AND,
+	INSN_OR,
+	INSN_NOT,
+};
+
+struct signal_insn
+{
+	enum signal_insn_op op;
+	uint32_t signo;
+	uint64_t value;
+};
+
+/**
+ * A start or stop condition, compiled from the parse tree given by the
+ * script when it is set.
+ *
+ * Only signals named in the expression can make it true by changing;
+ * a change to any other signal is equivalent to time passing.  So the
+ * trigger keeps a bitmask of the signals it depends on, and the value
+ * that it has when none of them changed.  That value can only change
+ * when one of the time predicates becomes true, so only the earliest
+ * of them needs to be watched.
+ */
+struct signal_trigger
+{
+	signal_expression_t *expr;
+	struct signal_insn code[MAX_TRIGGER_INSNS];
+	unsigned int len;
+	uint32_t deps[(MAX_SIGNALS + 31) / 32];
+	bool idle_value;
+	simulated_time_interval_t next_time;
+};
+
+struct signal_trigger signal_start_trigger, signal_stop_trigger;
 
 int signal_capture_active = 0;
 
@@ -82,6 +157,9 @@ uint64_t signal_trace_start_time;
 
 
 double signal_value (uint32_t signo);
+static void signal_trigger_arm (void);
+static void signal_trigger_fire (void);
+static bool signal_trigger_check_time (void);
 
 
 #ifdef CONFIG_AC
@@ -184,64 +262,270 @@ static signal_readings_t *signal_chunk_alloc (void)
 
 
 /**
- * Evaluate a signal expression.  The script parser converts the textual
- * expression into a parse tree, passed in EX.  SIG_CHANGED says whether or
- * not the current signal being scanned changed during the last time step.
+ * Compile a signal expression into trigger TR.  The expression tree is
+ * walked once, emitting instructions in postfix order.  Returns FALSE
+ * if the expression is too complex.
  */
-bool signal_expr_eval (unsigned int sig_changed, struct signal_expression *ex)
+static bool signal_trigger_compile (struct signal_trigger *tr,
+	struct signal_expression *ex)
 {
-	if (!ex)
+	struct signal_insn *insn;
+
+	if (tr->len == MAX_TRIGGER_INSNS)
 		return FALSE;
+	insn = &tr->code[tr->len];
 
 	switch (ex->op)
 	{
 		default:
-			return FALSE;
+			insn->op = INSN_FALSE;
+			break;
 
-		/* A signal name without any qualification is true when its value
-		changes */
 		case SIG_SIGNO:
-			if (ex->u.signo == sig_changed)
-				return TRUE;
+			insn->op = INSN_CHANGED;
+			insn->signo = ex->u.signo;
 			break;
 
-		case SIG_TIMEDIFF:
-			if (realtime_read () >= signal_trace_start_time + ex->u.value)
-				return TRUE;
+		case SIG_EQ:
+			insn->op = INSN_EQ;
+			insn->signo = ex->u.binary.left->u.signo;
+			insn->value = ex->u.binary.right->u.value;
 			break;
 
 		case SIG_TIME:
-			if (realtime_read () >= ex->u.value)
-				return TRUE;
+			insn->op = INSN_TIME;
+			insn->value = ex->u.timer;
 			break;
 
-		/* Indicates a "<signal> is <value>" expression.  True if
-		the signal has the exact value */
-		case SIG_EQ:
-			if (ex->u.binary.left->u.signo == sig_changed
-				&& signal_readings[sig_changed]->prev_state ==
-					ex->u.binary.right->u.value)
-				return TRUE;
+		case SIG_TIMEDIFF:
+			insn->op = INSN_TIMEDIFF;
+			insn->value = ex->u.timer;
 			break;
 
 		case SIG_AND:
-			if (signal_expr_eval (sig_changed, ex->u.binary.left)
-				&& signal_expr_eval (sig_changed, ex->u.binary.right))
-				return TRUE;
-			break;
-
 		case SIG_OR:
-			if (signal_expr_eval (sig_changed, ex->u.binary.left)
-				|| signal_expr_eval (sig_changed, ex->u.binary.right))
-				return TRUE;
+			if (!signal_trigger_compile (tr, ex->u.binary.left)
+				|| !signal_trigger_compile (tr, ex->u.binary.right)
+				|| tr->len == MAX_TRIGGER_INSNS)
+				return FALSE;
+			insn = &tr->code[tr->len];
+			insn->op = (ex->op == SIG_AND) ? INSN_AND : INSN_OR;
 			break;
 
 		case SIG_NOT:
-			if (!signal_expr_eval (sig_changed, ex->u.unary))
-				return TRUE;
+			if (!signal_trigger_compile (tr, ex->u.unary)
+				|| tr->len == MAX_TRIGGER_INSNS)
+				return FALSE;
+			insn = &tr->code[tr->len];
+			insn->op = INSN_NOT;
 			break;
 	}
-	return FALSE;
+
+	if ((insn->op == INSN_CHANGED || insn->op == INSN_EQ)
+		&& insn->signo < MAX_SIGNALS)
+		tr->deps[insn->signo / 32] |= 1UL << (insn->signo % 32);
+	tr->len++;
+	return TRUE;
+}
+
+
+/**
+ * Evaluate a compiled trigger.  SIG_CHANGED says which signal changed
+ * during the last time step, or SIGNO_UNCHANGED if none did.
+ */
+static bool signal_trigger_eval (struct signal_trigger *tr, uint32_t sig_changed)
+{
+	bool stack[MAX_TRIGGER_INSNS];
+	unsigned int sp = 0;
+	unsigned int pc;
+	simulated_time_interval_t now = realtime_read ();
+
+	for (pc = 0; pc < tr->len; pc++)
+	{
+		const struct signal_insn *insn = &tr->code[pc];
+		switch (insn->op)
+		{
+			case INSN_FALSE:
+				stack[sp++] = FALSE;
+				break;
+
+			/* A signal name without any qualification is true when its value
+			changes */
+			case INSN_CHANGED:
+				stack[sp++] = (insn->signo == sig_changed);
+				break;
+
+			/* Indicates a "<signal> is <value>" expression.  True if
+			the signal changed to the exact value */
+			case INSN_EQ:
+				stack[sp++] = (insn->signo == sig_changed)
+					&& (signal_value (insn->signo) == insn->value);
+				break;
+
+			case INSN_TIME:
+				stack[sp++] = (now >= insn->value);
+				break;
+
+			case INSN_TIMEDIFF:
+				stack[sp++] = (now >= signal_trace_start_time + insn->value);
+				break;
+
+			case INSN_AND:
+				sp--;
+				stack[sp-1] = stack[sp-1] && stack[sp];
+				break;
+
+			case INSN_OR:
+				sp--;
+				stack[sp-1] = stack[sp-1] || stack[sp];
+				break;
+
+			case INSN_NOT:
+				stack[sp-1] = !stack[sp-1];
+				break;
+		}
+	}
+	return stack[0];
+}
+
+
+/**
+ * Set the expression for a trigger, freeing the previous one.
+ * A NULL expression disables the trigger.
+ */
+static void signal_trigger_set (struct signal_trigger *tr,
+	struct signal_expression *ex)
+{
+	if (tr->expr)
+		expr_free (tr->expr);
+	memset (tr, 0, sizeof (*tr));
+	tr->expr = ex;
+
+	if (ex && !signal_trigger_compile (tr, ex))
+	{
+		simlog (SLC_DEBUG, "Capture condition too complex.");
+		tr->len = 0;
+	}
+}
+
+
+/**
+ * Return the trigger that is relevant now: the stop condition while
+ * capturing, else the start condition.
+ */
+static struct signal_trigger *signal_trigger_current (void)
+{
+	if (signal_capture_active && signal_capture_file)
+		return &signal_stop_trigger;
+	else
+		return &signal_start_trigger;
+}
+
+
+/**
+ * Write an unsigned value to a binary capture file, in varint form.
+ */
+static void signal_write_varint (unsigned long val)
+{
+	while (val >= 0x80)
+	{
+		putc ((val & 0x7F) | 0x80, signal_capture_file);
+		val >>= 7;
+	}
+	putc (val, signal_capture_file);
+}
+
+
+/**
+ * Write the header of a binary capture.  The set of columns is fixed
+ * from here until the capture ends.
+ */
+static void signal_write_binary_header (void)
+{
+	int sigin;
+
+	signal_capture_column_count = 0;
+	for (sigin = 0; sigin < MAX_CAPTURES; sigin++)
+	{
+		uint32_t signo = signals_being_captured[sigin];
+		if (signo)
+			signal_capture_columns[signal_capture_column_count++] = signo;
+	}
+
+	fwrite (SIGFILE_MAGIC, 4, 1, signal_capture_file);
+	putc (SIGFILE_VERSION, signal_capture_file);
+	signal_write_varint (signal_capture_column_count);
+	for (sigin = 0; sigin < signal_capture_column_count; sigin++)
+		signal_write_varint (signal_capture_columns[sigin]);
+}
+
+
+/**
+ * Write one record to a binary capture.  MASK says which columns have
+ * changed; their values are taken from signal_capture_values.
+ */
+static void signal_write_binary_record (uint32_t mask)
+{
+	simulated_time_interval_t now = realtime_read ();
+	int sigin;
+
+	signal_write_varint (now - signal_capture_last_time);
+	signal_write_varint (mask);
+	for (sigin = 0; sigin < signal_capture_column_count; sigin++)
+	{
+		if (!(mask & (1UL << sigin)))
+			continue;
+		if (signal_capture_columns[sigin] >= SIGNO_FIRST_AUTO)
+		{
+			float f = signal_capture_values[sigin];
+			uint32_t bits;
+			memcpy (&bits, &f, sizeof (bits));
+			putc (bits & 0xFF, signal_capture_file);
+			putc ((bits >> 8) & 0xFF, signal_capture_file);
+			putc ((bits >> 16) & 0xFF, signal_capture_file);
+			putc (bits >> 24, signal_capture_file);
+		}
+		else
+			putc (signal_capture_values[sigin] != 0.0, signal_capture_file);
+	}
+	signal_capture_last_time = now;
+}
+
+
+/**
+ * Write the values of all signals to a binary capture, if any of them
+ * changed since the last record.  If FORCE is nonzero, all of them
+ * are written regardless.
+ */
+static void signal_write_binary (int force)
+{
+	uint32_t mask = 0;
+	int sigin;
+
+	for (sigin = 0; sigin < signal_capture_column_count; sigin++)
+	{
+		double state = signal_value (signal_capture_columns[sigin]);
+		if (force || state != signal_capture_values[sigin])
+		{
+			signal_capture_values[sigin] = state;
+			mask |= 1UL << sigin;
+		}
+	}
+	if (mask)
+		signal_write_binary_record (mask);
+}
+
+
+/**
+ * Mark the end of a capture.  For binary captures, this records how
+ * long the final values were held.
+ */
+static void signal_capture_end (void)
+{
+	if (signal_capture_binary)
+		signal_write_binary_record (0);
+	fflush (signal_capture_file);
+	signal_capture_active = 0;
 }
 
 
@@ -252,6 +536,12 @@ bool signal_expr_eval (unsigned int sig_changed, struct signal_expression *ex)
 void signal_write_header (void)
 {
 	int sigin;
+
+	if (signal_capture_binary)
+	{
+		signal_write_binary_header ();
+		return;
+	}
 	fprintf (signal_capture_file, "# Time");
 	for (sigin = 0; sigin < MAX_CAPTURES; sigin++)
 	{
@@ -269,6 +559,12 @@ void signal_write_header (void)
 void signal_write (void)
 {
 	int sigin;
+
+	if (signal_capture_binary)
+	{
+		signal_write_binary (0);
+		return;
+	}
 	fprintf (signal_capture_file, "%lu", realtime_read ());
 	for (sigin = 0; sigin < MAX_CAPTURES; sigin++)
 	{
@@ -293,6 +589,7 @@ void signal_write (void)
 void signal_update (signal_number_t signo, unsigned int state)
 {
 	signal_readings_t *sigrd;
+	struct signal_trigger *tr;
 
 	/* Update last state */
 	if (state)
@@ -301,14 +598,10 @@ void signal_update (signal_number_t signo, unsigned int state)
 		signal_states[signo / 32] |= (1 << (signo % 32));
 
 	/* Don't do anything else if we're not tracing this signal. */
-	sigrd = signal_readings[signo];
+	sigrd = signal_readings_tail[signo];
 	if (!sigrd)
 		goto do_capture;
 
-	/* Move to the last block in the list of signal data. */
-	while (sigrd->next)
-		sigrd = sigrd->next;
-
 	/* Normalize state to 0/1 */
 	state = !!state;
 
@@ -336,6 +629,7 @@ void signal_update (signal_number_t signo, unsigned int state)
 		new_sigrd = signal_chunk_alloc ();
 		new_sigrd->init_state = sigrd->prev_state;
 		sigrd = sigrd->next = new_sigrd;
+		signal_readings_tail[signo] = sigrd;
 	}
 
 
@@ -344,26 +638,98 @@ void signal_update (signal_number_t signo, unsigned int state)
 	sigrd->prev_state = state;
 
 do_capture:
+	/* See if the capture should start or stop.  Only expressions that
+	name this signal need to be evaluated; otherwise the trigger has the
+	same value as when nothing changed. */
+	tr = signal_trigger_current ();
+	if (tr->len == 0)
+		return;
+	signal_trigger_check_time ();
+	if (tr->deps[signo / 32] & (1UL << (signo % 32)))
+	{
+		if (signal_trigger_eval (tr, signo))
+			signal_trigger_fire ();
+	}
+	else if (tr->idle_value)
+		signal_trigger_fire ();
+}
+
+
+/**
+ * Start or stop a capture, because the current trigger became true.
+ */
+static void signal_trigger_fire (void)
+{
 	if (signal_capture_active && signal_capture_file)
 	{
-		/* Also see if tracing should stop */
-		if (signal_stop_expr && signal_expr_eval (signo, signal_stop_expr))
-		{
-			simlog (SLC_DEBUG, "Capture complete.");
-			fflush (signal_capture_file);
-			signal_capture_active = 0;
-		}
+		simlog (SLC_DEBUG, "Capture complete.");
+		signal_capture_end ();
 	}
-	else if (signal_start_expr && signal_expr_eval (signo, signal_start_expr))
+	else if (signal_capture_file)
 	{
-		/* Otherwise, should capture start now because we meet the start
-		condition? */
 		simlog (SLC_DEBUG, "Capture started.");
 		signal_capture_active = 1;
 		signal_trace_start_time = realtime_read ();
 		signal_write_header ();
-		signal_write ();
+		if (signal_capture_binary)
+		{
+			signal_capture_last_time = 0;
+			signal_write_binary (1);
+		}
+		else
+			signal_write ();
+	}
+	signal_trigger_arm ();
+}
+
+
+/**
+ * Prepare the current trigger to be evaluated.  This computes its value
+ * while no signals are changing, and the next time at which a time
+ * predicate becomes true.  This must be called whenever the trigger
+ * changes, or a capture starts or stops.
+ */
+static void signal_trigger_arm (void)
+{
+	struct signal_trigger *tr = signal_trigger_current ();
+	simulated_time_interval_t now = realtime_read ();
+	simulated_time_interval_t next = 0;
+	simulated_time_interval_t when;
+	unsigned int pc;
+
+	tr->next_time = 0;
+	if (tr->len == 0)
+		return;
+
+	tr->idle_value = signal_trigger_eval (tr, SIGNO_UNCHANGED);
+
+	for (pc = 0; pc < tr->len; pc++)
+	{
+		if (tr->code[pc].op == INSN_TIME)
+			when = tr->code[pc].value;
+		else if (tr->code[pc].op == INSN_TIMEDIFF)
+			when = signal_trace_start_time + tr->code[pc].value;
+		else
+			continue;
+		if (when > now && (next == 0 || when < next))
+			next = when;
 	}
+	tr->next_time = next;
+}
+
+
+/**
+ * See if the next time predicate in the current trigger has become
+ * true, and if so, recompute its value while no signals change.
+ * Returns that value.
+ */
+static bool signal_trigger_check_time (void)
+{
+	struct signal_trigger *tr = signal_trigger_current ();
+
+	if (tr->next_time && realtime_read () >= tr->next_time)
+		signal_trigger_arm ();
+	return tr->len && tr->idle_value;
 }
 
 
@@ -373,10 +739,9 @@ do_capture:
  */
 void signal_capture_start (struct signal_expression *ex)
 {
-	if (signal_start_expr)
-		expr_free (signal_start_expr);
-	signal_start_expr = ex;
-	simlog (SLC_DEBUG, "Capture start condition set. %p", signal_start_expr);
+	signal_trigger_set (&signal_start_trigger, ex);
+	signal_trigger_arm ();
+	simlog (SLC_DEBUG, "Capture start condition set. %p", ex);
 }
 
 
@@ -387,10 +752,9 @@ void signal_capture_start (struct signal_expression *ex)
  */
 void signal_capture_stop (struct signal_expression *ex)
 {
-	if (signal_stop_expr)
-		expr_free (signal_stop_expr);
+	signal_trigger_set (&signal_stop_trigger, ex);
+	signal_trigger_arm ();
 	simlog (SLC_DEBUG, "Capture stop condition set.");
-	signal_stop_expr = ex;
 }
 
 
@@ -406,7 +770,8 @@ void signal_capture_add (uint32_t signo)
 		{
 			simlog (SLC_DEBUG, "Signal %d added to capture (#%d).", signo, sigin);
 			signals_being_captured[sigin] = signo;
-			signal_readings[signo] = signal_chunk_alloc ();
+			signal_readings[signo] = signal_readings_tail[signo] =
+				signal_chunk_alloc ();
 			return;
 		}
 	}
@@ -425,7 +790,7 @@ void signal_capture_del (uint32_t signo)
 		{
 			simlog (SLC_DEBUG, "Signal %d removed from capture (#%d).", signo, sigin);
 			signals_being_captured[sigin] = 0;
-			signal_readings[signo] = NULL;
+			signal_readings[signo] = signal_readings_tail[signo] = NULL;
 			return;
 		}
 	}
@@ -434,21 +799,15 @@ void signal_capture_del (uint32_t signo)
 /**
  * The periodic handler runs every millisecond.  If a capture is active,
  * it writes out the values of all signals being traced in this time step.
- * If a stop expression has been defined, then it also checks to see if
- * tracing should finish.
+ * It also checks whether a start or stop condition has become true just
+ * because time has passed.
  */
 static void signal_trace_periodic (void *data __attribute__((unused)))
 {
 	if (signal_capture_active)
-	{
 		signal_write ();
-		if (signal_stop_expr && signal_expr_eval (0, signal_stop_expr))
-		{
-			simlog (SLC_DEBUG, "Capture complete in periodic.");
-			fflush (signal_capture_file);
-			signal_capture_active = 0;
-		}
-	}
+	if (signal_trigger_check_time ())
+		signal_trigger_fire ();
 }
 
 
@@ -461,11 +820,34 @@ void signal_capture_set_file (const char *filename)
 	if (filename)
 	{
 		signal_capture_file = fopen (filename, "w");
+		if (signal_capture_file)
+			setvbuf (signal_capture_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
 	}
 	else if (signal_capture_file)
 	{
+		if (signal_capture_active)
+			signal_capture_end ();
 		fclose (signal_capture_file);
+		signal_capture_file = NULL;
+	}
+	signal_trigger_arm ();
+}
+
+
+/**
+ * Select the format of the capture file.  If BINARY is nonzero, the
+ * compact format in hwsim/sigfile.h is used; otherwise, one line of
+ * text is written per millisecond.  This must be set before the
+ * capture starts.
+ */
+void signal_capture_set_binary (int binary)
+{
+	if (signal_capture_active)
+	{
+		simlog (SLC_DEBUG, "Can't change format during capture.");
+		return;
 	}
+	signal_capture_binary = binary;
 }
 
 
@@ -475,7 +857,8 @@ void signal_capture_set_file (const char *filename)
 void signal_trace_start (signal_number_t signo)
 {
 	if (!signal_readings[signo])
-		signal_readings[signo] = signal_chunk_alloc ();
+		signal_readings[signo] = signal_readings_tail[signo] =
+			signal_chunk_alloc ();
 }
 
 
@@ -504,7 +887,7 @@ void signal_trace_stop (signal_number_t signo)
 		free (sigrd);
 		sigrd = next;
 	}
-	signal_readings[signo] = NULL;
+	signal_readings[signo] = signal_readings_tail[signo] = NULL;
 }
 
 
@@ -513,7 +896,8 @@ void signal_trace_stop (signal_number_t signo)
  */
 void signal_init (void)
 {
-	signal_start_expr = signal_stop_expr = NULL;
+	signal_trigger_set (&signal_start_trigger, NULL);
+	signal_trigger_set (&signal_stop_trigger, NULL);
 	signal_capture_active = 0;
 	sim_time_register (1, TRUE, signal_trace_periodic, NULL);
 }
@@ -31,32 +31,160 @@
  * other things, so there are no guarantees.
  */
 
-#define RING_COUNT 256
+/*
+ * Timers are kept in a hierarchical timing wheel.  The first level has
+ * one slot for each of the next RING_COUNT ticks.  Each of the higher
+ * levels has WHEEL_COUNT slots, each covering all of the slots of the
+ * level below it.  When the first level wraps around, the next slot of
+ * the second level is cascaded down, i.e. its timers are redistributed
+ * into the first level, and so on up.  Registering or expiring a timer
+ * is constant time no matter how far out it is scheduled.
+ */
+
+#define RING_BITS 8
+#define RING_COUNT (1UL << RING_BITS)
+#define RING_MASK (RING_COUNT - 1)
+
+#define WHEEL_BITS 6
+#define WHEEL_COUNT (1UL << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_COUNT - 1)
+
+/** The number of wheels above the first level ring */
+#define WHEEL_LEVELS 3
+
+/** The farthest out that a timer can be scheduled, in ticks */
+#define MAX_TIMEOUT ((1UL << (RING_BITS + WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+/** The number of timer entries to allocate whenever the pool is empty */
+#define POOL_CHUNK 64
 
-#define ring_later(ticks) ((ring_now + (ticks)) % RING_COUNT)
+#define wheel_shift(level) (RING_BITS + (level) * WHEEL_BITS)
 
+#define wheel_index(time, level) (((time) >> wheel_shift (level)) & WHEEL_MASK)
 
-/** The current time, modulo the ring count.  This is measured
- * in 1ms increments (more precisely, the number of IRQs). */
-unsigned int ring_now = 0;
+
+/** A list of timers which expire in the same slot.  New entries are
+ * added at the tail, so timers registered for the same tick are called
+ * in the order they were registered. */
+struct time_slot
+{
+	struct time_handler *head;
+	struct time_handler *tail;
+};
+
+
+/** The current time.  This is measured in 1ms increments (more
+ * precisely, the number of IRQs) since the simulation began. */
+static simulated_time_interval_t sim_time_now = 0;
 
 /** The timer ring.  Each entry contains a list of handlers to
  * be called when the current time reaches the value indicated
  * by the position in the array. */
-struct time_handler *time_handler_ring[RING_COUNT] = { NULL, };
+static struct time_slot time_handler_ring[RING_COUNT];
+
+/** The higher level wheels, for timers that are further out than
+ * the ring covers. */
+static struct time_slot time_handler_wheel[WHEEL_LEVELS][WHEEL_COUNT];
+
+/** Timer entries which are not in use */
+static struct time_handler *time_handler_free;
 
 
-/** Allocate a new timer ring entry */
+/** Allocate a new timer ring entry.  Entries are taken from a free list,
+ * which is refilled in chunks; they are never returned to the system. */
 static struct time_handler *ring_malloc (void)
 {
-	return malloc (sizeof (struct time_handler));
+	struct time_handler *elem;
+
+	if (time_handler_free == NULL)
+	{
+		struct time_handler *chunk;
+		int n;
+
+		chunk = malloc (POOL_CHUNK * sizeof (struct time_handler));
+		if (!chunk)
+			return NULL;
+		for (n = 0; n < POOL_CHUNK; n++)
+		{
+			chunk[n].next = time_handler_free;
+			time_handler_free = &chunk[n];
+		}
+	}
+
+	elem = time_handler_free;
+	time_handler_free = elem->next;
+	return elem;
 }
 
 
 /** Free a timer ring entry */
 static void ring_free (struct time_handler *elem)
 {
-	free (elem);
+	elem->next = time_handler_free;
+	time_handler_free = elem;
+}
+
+
+/** Append a timer entry to the tail of a slot */
+static void slot_append (struct time_slot *slot, struct time_handler *elem)
+{
+	elem->next = NULL;
+	if (slot->tail)
+		slot->tail->next = elem;
+	else
+		slot->head = elem;
+	slot->tail = elem;
+}
+
+
+/** Remove and return the entire list of timers in a slot */
+static struct time_handler *slot_take (struct time_slot *slot)
+{
+	struct time_handler *elem = slot->head;
+	slot->head = slot->tail = NULL;
+	return elem;
+}
+
+
+/** Queue a timer entry according to its expiry time.  The closer it is
+ * to expiring, the lower the level of the wheel that it goes into. */
+static void ring_insert (struct time_handler *elem)
+{
+	simulated_time_interval_t delta = elem->expires - sim_time_now;
+	int level;
+
+	if (delta < RING_COUNT)
+	{
+		slot_append (&time_handler_ring[elem->expires & RING_MASK], elem);
+		return;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS-1; level++)
+		if (delta < (1UL << wheel_shift (level+1)))
+			break;
+	slot_append (&time_handler_wheel[level][wheel_index (elem->expires, level)],
+		elem);
+}
+
+
+/** Move the timers from the current slot of a wheel level down into the
+ * lower levels.  If this level has also wrapped around, then the level
+ * above it is cascaded first. */
+static void ring_cascade (int level)
+{
+	struct time_handler *elem, *elem_next;
+	unsigned int index = wheel_index (sim_time_now, level);
+
+	if (index == 0 && level < WHEEL_LEVELS-1)
+		ring_cascade (level+1);
+
+	elem = slot_take (&time_handler_wheel[level][index]);
+	while (elem != NULL)
+	{
+		elem_next = elem->next;
+		ring_insert (elem);
+		elem = elem_next;
+	}
 }
 
 
@@ -67,20 +195,26 @@ static void ring_free (struct time_handler *elem)
  * the handler. */
 void sim_time_register (int n_ticks, int periodic_p, time_handler_t fn, void *data)
 {
-	unsigned int ring = ring_later (n_ticks);
-
 	struct time_handler *elem = ring_malloc ();
 	if (!elem)
+	{
 		simlog (SLC_DEBUG, "can't alloc ring");
+		return;
+	}
 
-	if (n_ticks > RING_COUNT)
+	if (n_ticks < 1)
+		n_ticks = 1;
+	else if (n_ticks > MAX_TIMEOUT)
+	{
 		simlog (SLC_DEBUG, "can't schedule timer that far out");
+		n_ticks = MAX_TIMEOUT;
+	}
 
-	elem->next = time_handler_ring[ring];
+	elem->expires = sim_time_now + n_ticks;
 	elem->periodicity = periodic_p ? n_ticks : 0;
 	elem->fn = fn;
 	elem->data = data;
-	time_handler_ring[ring] = elem;
+	ring_insert (elem);
 }
 
 
@@ -91,45 +225,34 @@ void sim_time_register (int n_ticks, int periodic_p, time_handler_t fn, void *da
  */
 void sim_time_step (void)
 {
-	struct time_handler *elem, *elem_next, *periodic;
+	struct time_handler *elem, *elem_next;
+
+	/* When the ring wraps around, pull down the timers that fall
+	 * within its next revolution */
+	if ((sim_time_now & RING_MASK) == 0)
+		ring_cascade (0);
 
 	/* Atomically get and clear the list of timers to
 	 * be executed on this tick */
-	elem = time_handler_ring[ring_now];
-	time_handler_ring[ring_now] = NULL;
+	elem = slot_take (&time_handler_ring[sim_time_now & RING_MASK]);
 
 	/* Call each timer function */
 	while (elem != NULL)
 	{
 		(*elem->fn) (elem->data);
 
+		elem_next = elem->next;
 		if (elem->periodicity)
 		{
 			/* If periodic, just requeue it rather than free/alloc */
-			elem_next = elem->next;
-
-
-			periodic = time_handler_ring[ring_later (elem->periodicity)];
-			if (!periodic)
-			{
-				time_handler_ring[ring_later (elem->periodicity)] = elem;
-			}
-			else
-			{
-				while (periodic->next != NULL)
-					periodic = periodic->next;
-				periodic->next = elem;
-			}
-			elem->next = NULL;
-			elem = elem_next;
+			elem->expires += elem->periodicity;
+			ring_insert (elem);
 		}
 		else
 		{
-			elem_next = elem->next;
 			ring_free (elem);
-			elem = elem_next;
 		}
+		elem = elem_next;
 	}
-	ring_now = ring_later (1);
+	sim_time_now++;
 }
-
@@ -135,6 +135,9 @@ void switch_stress_task (void)
 			/* Simulate the switch */
 			tp = task_create_gid (GID_SW_HANDLER, switch_sched_task);
 			task_set_arg (tp, sw);
+#ifdef CONFIG_SWITCH_LATENCY
+			switch_latency_dispatch (tp, sw);
+#endif
 		}
 	}
 }
@@ -1659,7 +1659,7 @@ void dev_random_test_task (void)
 		the draw function. */
 #if (MACHINE_DMD == 1)
 		dmd_alloc_low_clean ();
-		ptr = pinio_dmd_window_ptr (PINIO_DMD_WINDOW_0);
+		ptr = dmd_low_buffer;
 		len = DMD_PAGE_SIZE;
 		while (len > 0)
 		{
@@ -2127,6 +2127,173 @@ struct menu memory_editor_item = {
 
 /**********************************************************************/
 
+#ifdef CONFIG_SWITCH_LATENCY
+
+/* The switch latency test shows how long it took for each switch to
+ * reach its handler, as measured by kernel/swlatency.c.  All times are
+ * displayed in milliseconds.  Press Enter to clear the statistics. */
+
+void switch_item_number (U8 val);
+
+void switch_latency_test_init (void)
+{
+	browser_init ();
+	browser_item_number = switch_item_number;
+	browser_max = NUM_SWITCHES-1;
+}
+
+void switch_latency_test_draw (void)
+{
+	const struct switch_latency *lat = &sw_latency_stats[menu_selection];
+
+	sprintf ("N %ld MIN %ld AVG %ld MAX %ld", lat->count,
+		(U16)lat->min * SW_LATENCY_MS_PER_TICK,
+		(U16)switch_latency_average (menu_selection) * SW_LATENCY_MS_PER_TICK,
+		(U16)lat->max * SW_LATENCY_MS_PER_TICK);
+	font_render_string_left (&font_var5, 1, 8, sprintf_buffer);
+
+	sprintf ("Q %ld T %ld  %d %d %d %d %d %d",
+		(U16)lat->queue_max * SW_LATENCY_MS_PER_TICK,
+		(U16)lat->task_max * SW_LATENCY_MS_PER_TICK,
+		lat->buckets[0], lat->buckets[1], lat->buckets[2],
+		lat->buckets[3], lat->buckets[4], lat->buckets[5]);
+	font_render_string_left (&font_var5, 1, 14, sprintf_buffer);
+
+	sprintf_far_string (names_of_switches + menu_selection);
+	font_render_string_left (&font_var5, 24, 20, sprintf_buffer);
+
+	browser_draw ();
+}
+
+void switch_latency_test_enter (void)
+{
+	sound_send (SND_TEST_CONFIRM);
+	switch_latency_reset ();
+}
+
+void switch_latency_test_thread (void)
+{
+	for (;;)
+	{
+		task_sleep_sec (1);
+		window_redraw ();
+	}
+}
+
+struct window_ops switch_latency_test_window = {
+	INHERIT_FROM_BROWSER,
+	.init = switch_latency_test_init,
+	.draw = switch_latency_test_draw,
+	.enter = switch_latency_test_enter,
+	.thread = switch_latency_test_thread,
+};
+
+struct menu switch_latency_test_item = {
+	.name = "SWITCH LATENCY",
+	.flags = M_ITEM,
+	.var = { .subwindow = { &switch_latency_test_window, NULL } },
+};
+
+#endif /* CONFIG_SWITCH_LATENCY */
+
+/**********************************************************************/
+
+#ifdef CONFIG_CALLSET_PROFILE
+
+/* The callset profile test lists the event handlers that have taken
+ * the most time, as measured by kernel/callsetprof.c, slowest first.
+ * The list is refreshed every second.  Press Enter to clear it. */
+
+U16 callset_profile_test_order[CALLSET_PROFILE_TOP];
+
+U8 callset_profile_test_count;
+
+void callset_profile_item_number (U8 val)
+{
+	sprintf ("%d", val+1);
+}
+
+void callset_profile_test_update (void)
+{
+	callset_profile_test_count =
+		callset_profile_rank (callset_profile_test_order, CALLSET_PROFILE_TOP);
+	browser_max = callset_profile_test_count ? callset_profile_test_count-1 : 0;
+	if (menu_selection > browser_max)
+		menu_selection = browser_max;
+}
+
+void callset_profile_test_init (void)
+{
+	browser_init ();
+	browser_item_number = callset_profile_item_number;
+	callset_profile_test_update ();
+}
+
+void callset_profile_test_draw (void)
+{
+	U16 slot;
+	const struct callset_profile *prof;
+
+	if (menu_selection >= callset_profile_test_count)
+	{
+		font_render_string_center (&font_var5, 64, 14, "NO DATA");
+		browser_draw ();
+		return;
+	}
+
+	slot = callset_profile_test_order[menu_selection];
+	prof = &callset_profile_table[slot];
+
+	callset_profile_name (slot);
+	font_render_string_left (&font_var5, 1, 8, sprintf_buffer);
+
+	sprintf ("N %ld AVG %ld MAX %ld %s", prof->count,
+		(U16)callset_profile_average (slot), (U16)prof->worst,
+		CALLSET_PROFILE_UNITS);
+	font_render_string_left (&font_var5, 1, 14, sprintf_buffer);
+
+	sprintf ("TOTAL %ld MS",
+		(U16)(prof->total / CALLSET_PROFILE_UNITS_PER_MS));
+	font_render_string_left (&font_var5, 24, 20, sprintf_buffer);
+
+	browser_draw ();
+}
+
+void callset_profile_test_enter (void)
+{
+	sound_send (SND_TEST_CONFIRM);
+	callset_profile_reset ();
+	callset_profile_test_update ();
+}
+
+void callset_profile_test_thread (void)
+{
+	for (;;)
+	{
+		task_sleep_sec (1);
+		callset_profile_test_update ();
+		window_redraw ();
+	}
+}
+
+struct window_ops callset_profile_test_window = {
+	INHERIT_FROM_BROWSER,
+	.init = callset_profile_test_init,
+	.draw = callset_profile_test_draw,
+	.enter = callset_profile_test_enter,
+	.thread = callset_profile_test_thread,
+};
+
+struct menu callset_profile_test_item = {
+	.name = "CALLSET PROFILE",
+	.flags = M_ITEM,
+	.var = { .subwindow = { &callset_profile_test_window, NULL } },
+};
+
+#endif /* CONFIG_CALLSET_PROFILE */
+
+/**********************************************************************/
+
 struct menu *dev_menu_items[] = {
 #if (MACHINE_DMD == 1)
 	&dev_font_test_item,
@@ -2145,6 +2312,12 @@ struct menu *dev_menu_items[] = {
 	&sched_test_item,
 #ifndef CONFIG_NATIVE
 	&irqload_test_item,
+#endif
+#ifdef CONFIG_SWITCH_LATENCY
+	&switch_latency_test_item,
+#endif
+#ifdef CONFIG_CALLSET_PROFILE
+	&callset_profile_test_item,
 #endif
 	&score_test_item,
 #if (MACHINE_PIC == 1)
@@ -51,14 +51,14 @@
  * for better compression at the cost of a longer decompression time.
  *
  * Command-line parameters specify the total amount of space that is
- * allocated for images.  The linker should only compress as is
- * necessary: as long as there is ample space, it does not make sense
- * to compress.  If multiple codecs are available, then all should be
- * attempted and the one that matches the performance requirements the
- * best should be selected.  Images can also be tagged to denote those
- * where runtime performance is especially critical -- those would be
- * compressed *last*.  The linker continues to compress until
- * everything fits.  Then it builds the table and outputs the final image.
+ * allocated for images.  Every frame is encoded with all of the codecs,
+ * and the decode time of each encoding is estimated in CPU cycles.
+ * The linker then picks one encoding per frame so that the total
+ * decode time is minimal while everything still fits: as long as there
+ * is ample space, it does not make sense to compress.  Images can be
+ * given a weight to denote those where runtime performance is especially
+ * critical (or not at all); the decode time of each frame is multiplied
+ * by its weight.  Then it builds the table and outputs the final image.
  *
  * The output is placed in a file dedicated for images.  A separate part
  * of the build process copies that file into the actual game ROM.
@@ -82,9 +82,13 @@ do { \
 
 #define OPT_NEGATE 0x1
 #define OPT_FAST   0x2
+#define OPT_DELTA  0x4
 
 #define TYPE_BITMAP 0x80
 
+/* The raw encoding, plus one per entry in encoder_list, plus delta */
+#define MAX_CODECS 4
+
 
 enum image_format {
 	FORMAT_BAD, FORMAT_PGM
@@ -114,23 +118,32 @@ struct frame
    const char *name;
 
 	/*
-	 * The 'cost' of displaying this frame, in terms of the CPU power
-	 * available when it is being rendered.  A lower cost means that
-	 * the CPU is more likely to be idle when it is shown, and so it
-	 * can afford to be compressed more.  Likewise, a high cost means
-	 * that the CPU will be busy and it should not be compressed.
+	 * How much the time to decode this frame matters, in terms of the
+	 * CPU power available when it is being rendered.  Each decode cycle
+	 * is multiplied by this when choosing an encoding.  A low weight
+	 * means that the CPU is likely to be idle when it is shown, and so
+	 * it can afford to be compressed more.  A high weight is for frames
+	 * shown at busy times, which should decode quickly.
 	 *
-	 * The default cost is zero, which means average.  Negative cost
-	 * can be set for frames that are infrequent; positive cost for the
-	 * more difficult times.
+	 * The default weight is 1.  Zero means the decode time does not
+	 * matter at all.
+	 */
+	unsigned int weight;
+
+	/*
+	 * The candidate encodings of this frame, starting with the raw one,
+	 * and the number of CPU cycles needed to decode each.
 	 */
-	int cost;
+	unsigned int codec_count;
+	struct buffer *codec_buf[MAX_CODECS];
+	unsigned long codec_cycles[MAX_CODECS];
 
 	/*
-	 * Nonzero if this frame has already been scanned and cannot be
-	 * considered for further compression.
+	 * For frames of an animation, the same plane of the previous image.
+	 * The game draws this frame on top of that one, so it may be
+	 * encoded as a delta from it.
 	 */
-	int already_scanned;
+	struct frame *delta_base;
 };
 
 /** The master list of all frames */
@@ -261,90 +274,257 @@ encoder_t encoder_list[] = {
 };
 
 
+/*
+ * Approximate 6809 cycle counts for the frame decoders in
+ * platform/wpc/dmd.s.  These are used to compare the decode
+ * time of the different encodings of a frame.
+ */
+#define CYCLES_COPY_PAGE      3300  /* dmd_copy_asm */
+#define CYCLES_CLEAN_PAGE     930   /* dmd_clean_page */
+#define CYCLES_RLE_WORD       23    /* one literal word */
+#define CYCLES_RLE_RUN        37    /* start of a run */
+#define CYCLES_RLE_RUN_WORD   17    /* each word of a run */
+#define CYCLES_RLE_ESCAPE     38    /* a literal 0xA8 */
+#define CYCLES_BLOCK          27    /* start of a sparse or delta block */
+#define CYCLES_SPARSE_WORD    25
+#define CYCLES_DELTA_WORD     34
+
+/* A delta frame is drawn on a copy of the previous frame, which the
+caller makes with dmd_dup_mapped() only when the frame is a delta: one
+page copy for each plane. */
+#define CYCLES_DELTA_BASE     CYCLES_COPY_PAGE
+
+
 /**
- * Check if frames need to be compressed, and if so, systematically compress
- * them until everything fits.
+ * Return the estimated number of CPU cycles needed to decode
+ * an encoded frame.
  */
-void compress_frames (void)
+unsigned long decode_cycles (struct buffer *buf)
 {
-	struct frame *frame, *aframe;
-	int i;
-	unsigned long total_size;
-	struct buffer *newbuf;
+	unsigned long cycles = 0;
+	const U8 *p = buf->data;
 
-	/* Calculate the total size of ROM space needed.
-		We are conservative in our estimate here.
-		Add an extra 64 bytes per frame to estimate
-		cases where an image has to be pushed to the next page to keep all
-		the data together. */
-	total_size = (frame_count+1) * 3;
-	for (frame = frame_array, i = 0; i < frame_count; i++, frame++)
-		total_size += frame->curbuf->len + 1 + 64;
-
-	/* Compress until everything fits */
-	while (total_size > max_rom_size)
+	switch (buf->type & ~(TYPE_BITMAP | 0x1))
 	{
-		//printf ("Total size = %05X, ROM holds %05X\n", total_size, max_rom_size);
-
-		/* Find the uncompressed frame with lowest cost */
-		aframe = NULL;
-		for (frame = frame_array, i = 0; i < frame_count; i++, frame++)
-			if (!frame->already_scanned &&
-				!(frame->curbuf->type & TYPE_BITMAP) &&
-				(frame->cost < (aframe ? aframe->cost : 999)))
+		case 0:
+			return CYCLES_COPY_PAGE;
+
+		case 2:
+			for (;;)
+			{
+				if (p[0] != 0xA8)
+				{
+					cycles += CYCLES_RLE_WORD;
+					p += 2;
+				}
+				else if (p[1] & 0x80)
+					break;
+				else if (p[1] == 0)
+				{
+					cycles += CYCLES_RLE_ESCAPE;
+					p += 3;
+				}
+				else
+				{
+					cycles += CYCLES_RLE_RUN + p[1] * CYCLES_RLE_RUN_WORD;
+					p += 3;
+				}
+			}
+			return cycles;
+
+		case 4:
+		case 6:
+			if ((buf->type & 0x6) == 4)
+				cycles += CYCLES_CLEAN_PAGE;
+			else
+				cycles += CYCLES_DELTA_BASE;
+			while (*p != 0)
 			{
-				aframe = frame;
+				cycles += CYCLES_BLOCK + *p * (((buf->type & 0x6) == 4) ?
+					CYCLES_SPARSE_WORD : CYCLES_DELTA_WORD);
+				p += 2 + *p * 2;
 			}
+			return cycles;
 
-		/* If everything has been compressed already, and we don't fit still, then
-		just give up */
-		if (aframe == NULL)
-			error ("out of space after compression");
+		default:
+			error ("no cost model for frame type %02X", buf->type);
+	}
+}
 
-		//printf ("Will try to compress frame #%d\n", aframe - frame_array);
 
-		/* Mark this frame as checked, so we don't try again later.  This
-		is important in case all compression algorithms produce larger files
-		than what we started with. */
-		aframe->already_scanned = 1;
+/**
+ * Return the name of the encoding used by a frame.
+ */
+const char *codec_name (struct buffer *buf)
+{
+	static const char *names[] = { "raw", "rle", "sparse", "delta" };
+	return names[(buf->type & 0x6) >> 1];
+}
 
-		/* Try all compression methods.  Take the best one, or none at all
-		if compression fails in all cases */
-		for (i=0; i < sizeof (encoder_list) / sizeof (encoder_t); i++)
+
+/**
+ * Compute every possible encoding of each frame, along with its size
+ * and decode time.  Bitmaps are always left raw.
+ */
+void encode_frames (void)
+{
+	struct frame *frame;
+	int i, n;
+	struct buffer *newbuf;
+
+	for (frame = frame_array, i = 0; i < frame_count; i++, frame++)
+	{
+		frame->codec_count = 1;
+		frame->codec_buf[0] = frame->rawbuf;
+		frame->codec_cycles[0] = decode_cycles (frame->rawbuf);
+		if (frame->rawbuf->type & TYPE_BITMAP)
+			continue;
+
+		for (n = 0; n <= sizeof (encoder_list) / sizeof (encoder_t); n++)
 		{
-			newbuf = encoder_list[i] (aframe->rawbuf);
-			if (newbuf->len < aframe->curbuf->len)
-			{
-				/* This method is better than all previous ones.
-				Make it the current representation. */
-				/* printf ("Encoder %d reduces size from %d to %d\n", i,
-					aframe->curbuf->len, newbuf->len); */
-				newbuf->type |= aframe->rawbuf->type;
-				if (aframe->curbuf != aframe->rawbuf)
-					buffer_free (aframe->curbuf);
-				aframe->curbuf = newbuf;
-			}
+			if (n < sizeof (encoder_list) / sizeof (encoder_t))
+				newbuf = encoder_list[n] (frame->rawbuf);
+			else if (frame->delta_base)
+				newbuf = buffer_delta_encode (frame->rawbuf,
+					frame->delta_base->rawbuf);
 			else
+				break;
+
+			newbuf->type |= frame->rawbuf->type;
+			frame->codec_buf[frame->codec_count] = newbuf;
+			frame->codec_cycles[frame->codec_count] = decode_cycles (newbuf);
+			frame->codec_count++;
+		}
+	}
+}
+
+
+/**
+ * Choose an encoding for every frame, so that everything fits in the
+ * ROM while the total decode time, weighted by each frame's weight,
+ * is as small as possible.
+ *
+ * This is a multiple-choice knapsack problem, which is solved exactly
+ * by dynamic programming over the space used.  To keep the table a
+ * reasonable size, space is counted in units of several bytes when
+ * the ROM is large; sizes are rounded up, so the result always fits.
+ */
+void compress_frames (void)
+{
+	struct frame *frame;
+	int i, k;
+	long budget;
+	unsigned long unit, cap, c, size, cost;
+	unsigned long *best, *next;
+	unsigned char *choice;
+	const unsigned long no_solution = ~0UL;
+
+	/* Calculate the space available for the image data.
+		We are conservative in our estimate here.
+		Allow an extra 64 bytes per frame to estimate
+		cases where an image has to be pushed to the next page to keep all
+		the data together. */
+	budget = max_rom_size - (frame_count+1) * 3;
+	budget -= frame_count * (1 + 64);
+	if (budget < 0)
+		error ("out of space for the frame table");
+
+	unit = 1 + ((unsigned long)budget * frame_count) / (32UL * 1024 * 1024);
+	cap = budget / unit;
+
+	best = malloc ((cap + 1) * sizeof (unsigned long));
+	next = malloc ((cap + 1) * sizeof (unsigned long));
+	choice = malloc ((unsigned long)frame_count * (cap + 1));
+	if (!best || !next || !choice)
+		error ("out of memory");
+
+	/* best[c] is the least weighted decode time of the frames seen so far,
+	using at most C units of space */
+	for (c = 0; c <= cap; c++)
+		best[c] = 0;
+
+	for (frame = frame_array, i = 0; i < frame_count; i++, frame++)
+	{
+		unsigned char *fchoice = choice + (unsigned long)i * (cap + 1);
+		for (c = 0; c <= cap; c++)
+		{
+			next[c] = no_solution;
+			for (k = 0; k < frame->codec_count; k++)
 			{
-				/* This method is not better, so just discard it. */
-				//printf ("Encoder %d gave %d bytes, ignoring\n", i, newbuf->len);
-				buffer_free (newbuf);
+				size = (frame->codec_buf[k]->len + unit - 1) / unit;
+				if (size > c || best[c - size] == no_solution)
+					continue;
+				cost = best[c - size] + frame->weight * frame->codec_cycles[k];
+				if (cost < next[c])
+				{
+					next[c] = cost;
+					fchoice[c] = k;
+				}
 			}
 		}
+		memcpy (best, next, (cap + 1) * sizeof (unsigned long));
+	}
 
-		/* Adjust total size, by examining difference between original buffer
-		size and the compressed buffer size */
-		total_size -= (aframe->rawbuf->len - aframe->curbuf->len);
+	if (best[cap] == no_solution)
+		error ("out of space after compression");
+
+	/* Walk back through the table to find the choice for each frame */
+	c = cap;
+	for (i = frame_count - 1; i >= 0; i--)
+	{
+		frame = &frame_array[i];
+		k = choice[(unsigned long)i * (cap + 1) + c];
+		frame->curbuf = frame->codec_buf[k];
+		c -= (frame->curbuf->len + unit - 1) / unit;
 	}
-	/* printf ("Done compressing.  Total size %05X is less than ROM size %05X\n",
-		total_size, max_rom_size); */
+
+	free (best);
+	free (next);
+	free (choice);
+}
+
+
+/**
+ * Write a report of the encoding chosen for each frame.
+ */
+void write_report (const char *filename)
+{
+	FILE *fp;
+	struct frame *frame;
+	int i, k;
+	unsigned long total_size = 0;
+	unsigned long total_cycles = 0;
+
+	fp = fopen (filename, "w");
+	if (!fp)
+		error ("can't open report file '%s'\n", filename);
+
+	fprintf (fp, "%-5s %-28s %-6s %6s %6s %6s   %s\n",
+		"frame", "label", "codec", "bytes", "cycles", "weight", "(alternatives)");
+	for (frame = frame_array, i = 0; i < frame_count; i++, frame++)
+	{
+		fprintf (fp, "%-5d %-28s %-6s %6d %6lu %6u  ",
+			i, frame->name ? frame->name : "-",
+			codec_name (frame->curbuf), frame->curbuf->len,
+			decode_cycles (frame->curbuf), frame->weight);
+		for (k = 0; k < frame->codec_count; k++)
+			if (frame->codec_buf[k] != frame->curbuf)
+				fprintf (fp, " %s %d/%lu", codec_name (frame->codec_buf[k]),
+					frame->codec_buf[k]->len, frame->codec_cycles[k]);
+		fprintf (fp, "\n");
+		total_size += frame->curbuf->len + 1;
+		total_cycles += decode_cycles (frame->curbuf);
+	}
+	fprintf (fp, "\n%d frames, %lu bytes of %lu, %lu decode cycles\n",
+		frame_count, total_size, max_rom_size, total_cycles);
+	fclose (fp);
 }
 
 
 /**
  * Add a new frame.
  */
-void add_frame (const char *label, struct buffer *buf)
+void add_frame (const char *label, struct buffer *buf, unsigned int weight)
 {
 	struct frame *frame;
 
@@ -357,9 +537,9 @@ void add_frame (const char *label, struct buffer *buf)
 	frame = &frame_array[frame_count];
 	frame->rawbuf = buf;
 	frame->curbuf = buf;
-	frame->name = NULL;
-	frame->cost = 0;
-	frame->already_scanned = 0;
+	frame->name = label ? strndup (label, strcspn (label, ":")) : NULL;
+	frame->weight = weight;
+	frame->delta_base = NULL;
 	frame_count++;
 }
 
@@ -403,7 +583,8 @@ struct buffer *pgm_get_plane (struct buffer *buf, unsigned int plane)
 /**
  * Add a new image file to the frame list.
  */
-void add_image (const char *label, const char *filename, unsigned int options)
+void add_image (const char *label, const char *filename, unsigned int options,
+	unsigned int weight)
 {
 	FILE *imgfile;
 	struct buffer *buf;
@@ -443,7 +624,20 @@ void add_image (const char *label, const char *filename, unsigned int options)
 		planebuf->type = (!plane ? 0x1 : 0x0);
 		if ((buf->width < 128) || (buf->height < 32))
 			planebuf->type |= TYPE_BITMAP;
-		add_frame (!plane ? label : NULL, planebuf);
+		add_frame (!plane ? label : NULL, planebuf, weight);
+
+		/* An image marked as part of an animation can be stored as
+		a delta from the previous image, which will already be on the
+		display.  Both must be full frames. */
+		if (options & OPT_DELTA)
+		{
+			struct frame *frame = &frame_array[frame_count-1];
+			if ((frame - frame_array < 2)
+				|| (frame->rawbuf->type & TYPE_BITMAP)
+				|| (frame[-2].rawbuf->type & TYPE_BITMAP))
+				error ("'%s' cannot be a delta frame\n", filename);
+			frame->delta_base = &frame[-2];
+		}
 	}
 
 	/* Free the original image buffer */
@@ -549,6 +743,7 @@ void parse_config (const char *filename)
 		char *label;
 		char *filename;
 		unsigned int options = 0;
+		unsigned int weight = 1;
 
 		fgets (line, 255, cfgfile);
 		if (feof (cfgfile))
@@ -562,10 +757,15 @@ void parse_config (const char *filename)
 				break;
 			else if (strchr (word, ':'))
 				label = word;
-			else if (*word == '!')
+			else if (!strncmp (word, "weight=", 7))
+				weight = strtoul (word+7, NULL, 0);
+			else if (*word == '!' || *word == '+')
 			{
-				filename = word+1;
-				options |= OPT_NEGATE;
+				/* '!' inverts the image.  '+' says that it follows the
+				previous image in an animation. */
+				while (*word == '!' || *word == '+')
+					options |= (*word++ == '!') ? OPT_NEGATE : OPT_DELTA;
+				filename = word;
 			}
 			else if (*word)
 				filename = word;
@@ -573,7 +773,7 @@ void parse_config (const char *filename)
 		}
 
 		if (filename)
-			add_image (label, filename, options);
+			add_image (label, filename, options, weight);
 	}
 	fclose (cfgfile);
 }
@@ -586,6 +786,7 @@ int main (int argc, char *argv[])
 	const char *outfilename;
 	const char *tmpfilename = "lblfile.tmp";
 	const char *lblfilename = NULL;
+	const char *reportfilename = NULL;
 
 	/* Open the label file */
 	lblfile = fopen (tmpfilename, "w");
@@ -606,6 +807,7 @@ int main (int argc, char *argv[])
 					printf ("-i <include-file>            Writes #defines to this include file\n");
 					printf ("-o <output-file>             Writes final image data to this file\n");
 					printf ("-p <page>                    Set the base page number\n");
+					printf ("-r <report-file>             Writes the encoding chosen for each frame\n");
 					printf ("-s <1k-blocks>               Set the maximum output file size\n");
 					exit (0);
 
@@ -621,6 +823,10 @@ int main (int argc, char *argv[])
 					base_page = strtoul (argv[++argn], NULL, 0);
 					break;
 
+				case 'r':
+					reportfilename = argv[++argn];
+					break;
+
 				case 's':
 					max_rom_size = 1024 * strtoul (argv[++argn], NULL, 0);
 					break;
@@ -634,8 +840,12 @@ int main (int argc, char *argv[])
 		}
 	}
 
-	/* Try to compress frames if necessary */
+	/* Try every encoding of each frame, and pick the best ones
+	that fit */
+	encode_frames ();
 	compress_frames ();
+	if (reportfilename)
+		write_report (reportfilename);
 
 	/* Write the image table */
 	write_output (outfilename);
@@ -820,9 +820,13 @@ struct buffer *buffer_rle_encode (struct buffer *buf)
 			run++;
 
 			/* If this byte begins a run of 4 or more of the same value, then
-			it can be emitted in a more compact form. */
+			it can be emitted in a more compact form.  The word count must
+			fit in 7 bits, since the decoder treats a negative count as
+			the end of the image. */
 			if (run >= 4)
 			{
+				if (run > 254)
+					run = 254;
 				run &= ~1; /* round down to multiple of 2 */
 				*dstp++ = 0xA8;
 				*dstp++ = run / 2;
@@ -859,75 +863,91 @@ struct buffer *buffer_rle_decode (struct buffer *buf)
 }
 
 
-struct buffer *buffer_sparse_encode (struct buffer *buf)
+/**
+ * Write the nonzero 16-bit words of a 512-byte frame as a series of
+ * <count, skip, data...> blocks, ending with a zero count.  SKIP is the
+ * number of bytes of zero words omitted before the block, and COUNT
+ * says how many literal words follow.  Returns the new output pointer.
+ */
+static U8 *buffer_encode_words (U8 *dstp, const U8 *data)
 {
-	U8 *dstp, *srcp;
-	struct buffer *res;
-	int zeroes, count;
+	unsigned int off, skip, count;
 
-	res = buffer_clone (buf);
-	srcp = buf->data;
-	dstp = res->data;
-
-	/* Encode the buffer as a series of <skip, count, data...> tuples.
-	 * SKIP indicates the number of zero bytes that are omitted from
-	 * the image.  COUNT says how many literal 16-bit words follow.
-	 */
-	while (srcp < buf->data + 512)
+#define word_nonzero(off) (data[off] || data[(off)+1])
+	off = 0;
+	while (off < 512)
 	{
-
-		/* See how many following bytes are zero.
-		 * Strip them from the input.
-		 * The skip value (zeroes) cannot exceed 126 for the 6809,
-		 * due to the way the algorithm is written in assembler.  Detect this,
-		 * and emit a 'dummy block' which skips as much as possible.
-		 */
-		zeroes = 0;
-		while (*srcp == 0 && zeroes < 126 && srcp < buf->data + 512)
+		/* Skip over the zero words.  The skip cannot exceed 126 bytes
+		 * for the 6809, due to the way the decoders are written. */
+		skip = 0;
+		while (off < 512 && !word_nonzero (off) && skip < 126)
 		{
-			zeroes++;
-			srcp++;
+			skip += 2;
+			off += 2;
 		}
+		if (off >= 512)
+			break;
 
-		/* See how many following bytes are zero.
-		 * Don't strip them from the input yet. */
+		/* Count the nonzero words.  If the skip limit was hit, this
+		 * may be zero; emit one zero word anyway, which is harmless,
+		 * since a zero count would end the frame. */
 		count = 0;
-		while (srcp[count] != 0 && srcp + count < buf->data + 512)
-		{
+		while (off + count * 2 < 512 && word_nonzero (off + count * 2)
+			&& count < 255)
 			count++;
-		}
-
-		/* The size of each literal block needs to be word aligned.
-		 * If not, add a zero back in, preferably from the amount
-		 * just skipped, otherwise from the following data. */
-		if (count & 1)
-		{
-			if (zeroes != 0)
-			{
-				zeroes--;
-				srcp--;
-			}
-			count++;
-		}
+		if (count == 0)
+			count = 1;
 
 		/* Write the block */
-		*dstp++ = count / 2;
-		if (count > 0)
-		{
-			*dstp++ = zeroes;
-			memcpy (dstp, srcp, count);
-			dstp += count;
-			srcp += count;
-		}
+		*dstp++ = count;
+		*dstp++ = skip;
+		memcpy (dstp, data + off, count * 2);
+		dstp += count * 2;
+		off += count * 2;
 	}
+#undef word_nonzero
 
 	/* Add final 0x00 to mark end of frame */
 	*dstp++ = 0;
-	res->len = dstp - res->data;
+	return dstp;
+}
+
+
+/**
+ * Encode a joined bitmap in the sparse format, which omits the
+ * zero words.  The decoder clears the page first.
+ */
+struct buffer *buffer_sparse_encode (struct buffer *buf)
+{
+	struct buffer *res;
+
+	res = buffer_clone (buf);
+	res->len = buffer_encode_words (res->data, buf->data) - res->data;
 	res->type |= 0x4;
 	return res;
 }
 
+
+/**
+ * Encode a joined bitmap as the exclusive-OR delta from PREV, the
+ * frame that is already on the display when this one is drawn.
+ *
+ * This is the sparse format applied to the delta: only the words
+ * which differ from PREV are present, and the decoder XORs them onto
+ * the page instead of clearing it first.
+ */
+struct buffer *buffer_delta_encode (struct buffer *buf, struct buffer *prev)
+{
+	struct buffer *delta, *res;
+
+	delta = buffer_compute_delta (buf, prev);
+	res = buffer_clone (buf);
+	res->len = buffer_encode_words (res->data, delta->data) - res->data;
+	res->type |= 0x6;
+	buffer_free (delta);
+	return res;
+}
+
 /********************************************************************/
 
 
@@ -39,6 +39,22 @@
  *                 This could be used if multiple schedules need to be
  *                 compiled into a single program.
  *
+ * -P              Generate profiling code.  Each call is timed, and the
+ *                 worst and average time are kept in <prefix>_profile[].
+ *                 A table describing each call, <prefix>_profile_info[],
+ *                 is also written, so that the measured time can be
+ *                 reported against the estimate and CYCLES_PER_TICK.
+ *                 See the CONFIG_SCHED_PROFILE support in interrupt.h.
+ *
+ * -m <profile>    Balance the schedule using measured times instead of the
+ *                 estimates.  The profile is the output of rtt_profile_dump();
+ *                 only lines beginning with 'RTT' are read, so a whole
+ *                 debug log can be given.  See below.
+ *
+ * -S <scale>      The number of CPU cycles per unit in the profile (1).
+ *                 Native profiles are in nanoseconds, so this must be
+ *                 given to make them comparable to the 6809.
+ *
  * Each input file is a list of items to be scheduled, generally as follows:
  * <name> <period> <length>
  *
@@ -55,6 +71,12 @@
  * The scheduler performs a 'load balancing' function based on the duration
  * of each task.  It tries to place tasks into equal-sized buckets, so that
  * on each interrupt, roughly the same amount of CPU is used.
+ *
+ * When a profile is given, the measured average and worst case of each task
+ * replace its estimate.  The task offsets are then searched to minimize the
+ * worst-case load of any one interrupt, and only then the average, since
+ * it is the worst case which causes IRQ jitter.  A report of the load per
+ * tick before and after rebalancing is printed to stderr.
  */
 
 #include <stdio.h>
@@ -109,10 +131,25 @@ struct task
 	unsigned int next_p;
 #endif
 
+	/* The worst-case length of time, in ticks.  Without a profile,
+	this is the same as the estimate. */
+	double worst;
+
+	/* Nonzero if the lengths came from a profile */
+	int measured_p;
+
 	int already_unrolled_count;
 
 	/* The number of slots in which this task is scheduled */
 	int n_slots;
+
+	/* The number of slots that the task needs, and the divider
+	for each of them */
+	unsigned int count;
+	unsigned int divider;
+
+	/* The first tick that the task is placed in */
+	unsigned int base;
 };
 
 
@@ -134,6 +171,18 @@ struct tick
 };
 
 
+/* A profiled call.  There is one of these for each slot in each
+tick, in the order that they are written out. */
+
+struct profile_slot
+{
+	char name[MAX_ID];
+	unsigned int tick;
+	unsigned int divider;
+	unsigned int estimate;
+};
+
+
 /* The master scheduling table.  Each 'unrolled' version
 of the handler is assigned to a different element in ticks.
 n_ticks is the number of such ticks that are being used. */
@@ -174,6 +223,19 @@ const unsigned int cycles_per_interrupt = CYCLES_PER_TICK;
 int n_conditionals = 0;
 const char *conditionals[MAX_CONDITIONALS];
 
+/* Nonzero if profiling code should be generated */
+int profile_p = 0;
+
+/* The table of profiled calls */
+unsigned int n_profile_slots = 0;
+struct profile_slot profile_slots[MAX_TICKS * MAX_SLOTS_PER_TICK];
+
+/* The measured profile to balance against, if any */
+const char *profile_file = NULL;
+
+/* The number of cycles per unit of time in the profile */
+double profile_scale = 1.0;
+
 
 #define cfprintf(ind, file, format, rest...) \
 do { \
@@ -206,6 +268,46 @@ static void write_time_comment (FILE *f, double time)
 }
 
 
+/**
+ * Write the code to time a call that was just written, and remember
+ * the call so that it can be described in the profile table.
+ */
+static void write_profile_call (unsigned int indent, FILE *f,
+	const char *name, unsigned int tickno, struct slot *slot)
+{
+	struct profile_slot *ps = &profile_slots[n_profile_slots];
+
+	strcpy (ps->name, name);
+	ps->tick = tickno;
+	ps->divider = slot->divider;
+	ps->estimate = (unsigned int)(slot->task->len * CYCLES_PER_TICK + 0.5);
+	cfprintf (indent, f, "rtt_profile_end (&%s_profile[%d]);\n",
+		prefix, n_profile_slots);
+	n_profile_slots++;
+}
+
+
+/**
+ * Write the table that describes each profiled call.
+ */
+static void write_profile_info (FILE *f)
+{
+	unsigned int n;
+
+	fprintf (f, "const struct rtt_profile_info %s_profile_info[] = {\n", prefix);
+	for (n=0; n < n_profile_slots; n++)
+	{
+		struct profile_slot *ps = &profile_slots[n];
+		fprintf (f, "\t{ \"%s\", %d, %d, %d },\n",
+			ps->name, ps->tick, ps->divider, ps->estimate);
+	}
+	fprintf (f, "};\n\n");
+	fprintf (f, "const U8 %s_profile_slots = %d;\n\n", prefix, n_profile_slots);
+	fprintf (f, "const U16 %s_profile_cycles_per_tick = %d;\n\n",
+		prefix, CYCLES_PER_TICK);
+}
+
+
 /**
  * Write the driver code to the output file.
  */
@@ -228,6 +330,14 @@ void write_tick_driver (FILE *f)
 		fprintf (f, "#include \"%s\"\n", include_files[n].name);
 	fprintf (f, "\n");
 
+	if (profile_p)
+	{
+		unsigned int n_slots = 0;
+		for (n=0; n < n_ticks; n++)
+			n_slots += ticks[n].n_slots;
+		fprintf (f, "struct rtt_profile %s_profile[%d];\n\n", prefix, n_slots);
+	}
+
 	/* Check for tasks that could be improved */
 
 	for (n=0; n < n_tasks; n++)
@@ -279,6 +389,9 @@ void write_tick_driver (FILE *f)
 		cfprintf (indent, f, "   m6809_firq_save_regs ();\n");
 		cfprintf (indent, f, "#endif\n");
 
+		if (profile_p)
+			cfprintf (indent, f, "rtt_profile_begin ();\n");
+
 		for (div = 1; div <= max_divider; div *= 2)
 		{
 			unsigned int used = 0;
@@ -321,6 +434,9 @@ void write_tick_driver (FILE *f)
 					cfprintf (indent, f, "%s (); ", task_name);
 					write_time_comment (f, slot->task->len);
 					fprintf (f, "\n");
+
+					if (profile_p)
+						write_profile_call (indent, f, task_name, n, slot);
 				}
 			}
 		}
@@ -370,6 +486,9 @@ void write_tick_driver (FILE *f)
 	cfprintf (indent, f, "   %s_function = %s_0;\n", prefix, prefix);
 	cfprintf (indent, f, "   %s_divider = 0;\n", prefix);
 	cfprintf (indent, f, "}\n\n");
+
+	if (profile_p)
+		write_profile_info (f);
 }
 
 
@@ -491,8 +610,7 @@ struct slot *alloc_slot (unsigned int tickno)
  */
 void add_task (char *name, unsigned int period, double len)
 {
-	unsigned int count, base;
-	struct slot *slot;
+	unsigned int count;
 	struct task *task;
 	unsigned int divider = 1;
 	char *end;
@@ -544,6 +662,8 @@ conditional_defined:;
 	strcpy (task->name, name);
 	task->period = period;
 	task->len = len;
+	task->worst = len;
+	task->measured_p = 0;
 	task->already_unrolled_count = already_unrolled_count;
 	task->n_slots = 0;
 
@@ -598,34 +718,390 @@ conditional_defined:;
 	}
 
 	/* The number of times the task must be scheduled is now
-	known.  Now choose which instances of the interrupt handler
-	it will go into.  BASE will be a value between 0 and n_ticks,
-	which says which is the first tick to be used.  If the task
-	is scheduled multiple times, it will be spread evenly
-	across all ticks. */
+	known.  Which instances of the interrupt handler it goes
+	into is decided later, by schedule_tasks(). */
+	task->count = count;
+	task->divider = divider;
+}
 
-	base = find_best_tick (period, count, len);
+
+/**
+ * Place a task into the schedule.  BASE will be a value between 0 and
+ * n_ticks, which says which is the first tick to be used.  If the task
+ * is scheduled multiple times, it will be spread evenly across all ticks.
+ */
+void place_task (struct task *task, unsigned int base)
+{
+	unsigned int count = task->count;
+	struct slot *slot;
+
+	task->base = base;
 
 	/* Create the slots (calls) */
 
 	while (count > 0)
 	{
 		slot = alloc_slot (base);
-		slot->divider = divider;
+		slot->divider = task->divider;
 		slot->task = task;
 		task->n_slots++;
 
 		/* Update the running count of how much time is
 		spent running this tick, on average. */
-		ticks[base].len += (task->len / divider);
+		ticks[base].len += (task->len / task->divider);
 
 		/* Move to the next tick, spreading evenly. */
-		base = (base + period) % n_ticks;
+		base = (base + task->period) % n_ticks;
 		count--;
 	}
 }
 
 
+/**
+ * Remove every task from the schedule.
+ */
+void unplace_tasks (void)
+{
+	unsigned int n;
+
+	for (n=0; n < n_ticks; n++)
+	{
+		ticks[n].n_slots = 0;
+		ticks[n].len = 0.0;
+	}
+	for (n=0; n < n_tasks; n++)
+		tasks[n].n_slots = 0;
+}
+
+
+/**
+ * Place the tasks using their estimated lengths.  Each task, in the
+ * order given, goes where there is the least work already.
+ */
+void place_tasks_by_estimate (void)
+{
+	unsigned int n;
+
+	for (n=0; n < n_tasks; n++)
+	{
+		struct task *task = &tasks[n];
+		place_task (task, find_best_tick (task->period, task->count, task->len));
+	}
+}
+
+
+/**
+ * Return the number of choices for the first tick of a task.
+ */
+static unsigned int task_base_choices (const struct task *task)
+{
+	if (task->divider > 1)
+		return n_ticks;
+	else
+		return n_ticks / task->count;
+}
+
+
+/**
+ * Calculate the average and worst-case load on each tick, in ticks,
+ * if each task were placed at BASES[n].  Tasks whose base is -1 are
+ * left out.  A task with a divider adds its full worst case, since
+ * that is what happens on the iterations where it runs.
+ */
+static void compute_loads (const int *bases, double *avg, double *worst)
+{
+	unsigned int n, count;
+	int base;
+
+	for (n=0; n < n_ticks; n++)
+		avg[n] = worst[n] = 0.0;
+
+	for (n=0; n < n_tasks; n++)
+	{
+		const struct task *task = &tasks[n];
+		if ((base = bases[n]) < 0)
+			continue;
+		for (count = 0; count < task->count; count++)
+		{
+			avg[base] += task->len / task->divider;
+			worst[base] += task->worst;
+			base = (base + task->period) % n_ticks;
+		}
+	}
+}
+
+
+/** The cost of a particular schedule */
+struct sched_cost
+{
+	double peak_worst;
+	double peak_avg;
+	double sumsq_worst;
+};
+
+
+static void compute_cost (const int *bases, struct sched_cost *cost)
+{
+	double avg[MAX_TICKS], worst[MAX_TICKS];
+	unsigned int n;
+
+	compute_loads (bases, avg, worst);
+	cost->peak_worst = cost->peak_avg = cost->sumsq_worst = 0.0;
+	for (n=0; n < n_ticks; n++)
+	{
+		if (worst[n] > cost->peak_worst)
+			cost->peak_worst = worst[n];
+		if (avg[n] > cost->peak_avg)
+			cost->peak_avg = avg[n];
+		cost->sumsq_worst += worst[n] * worst[n];
+	}
+}
+
+
+/**
+ * Return nonzero if cost A is better than cost B.  The worst case
+ * matters most, then the average.  The sum of squares breaks ties
+ * in favor of spreading the worst cases evenly.
+ */
+static int cost_better_p (const struct sched_cost *a, const struct sched_cost *b)
+{
+	const double epsilon = 1e-9;
+
+	if (a->peak_worst < b->peak_worst - epsilon)
+		return 1;
+	if (a->peak_worst > b->peak_worst + epsilon)
+		return 0;
+	if (a->peak_avg < b->peak_avg - epsilon)
+		return 1;
+	if (a->peak_avg > b->peak_avg + epsilon)
+		return 0;
+	return a->sumsq_worst < b->sumsq_worst - epsilon;
+}
+
+
+/**
+ * Move task N to whichever base gives the best schedule, given where
+ * all of the other tasks are.  Returns nonzero if it moved.
+ */
+static int improve_task (int *bases, unsigned int n)
+{
+	struct sched_cost best_cost, cost;
+	unsigned int base, choices = task_base_choices (&tasks[n]);
+	int best = bases[n];
+
+	if (best >= 0)
+		compute_cost (bases, &best_cost);
+
+	for (base = 0; base < choices; base++)
+	{
+		bases[n] = base;
+		compute_cost (bases, &cost);
+		if (best < 0 || cost_better_p (&cost, &best_cost))
+		{
+			best = base;
+			best_cost = cost;
+		}
+	}
+
+	if (best != bases[n])
+	{
+		bases[n] = best;
+		return 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Choose the bases for all tasks to minimize the worst-case load.
+ * The tasks are first placed greedily, largest worst case first; then
+ * each task in turn is moved to its best position, until no move helps.
+ */
+static void optimize_bases (int *bases)
+{
+	unsigned int order[MAX_TASKS];
+	unsigned int n, m, pass, tmp;
+	int moved;
+
+	for (n=0; n < n_tasks; n++)
+	{
+		order[n] = n;
+		bases[n] = -1;
+	}
+
+	for (n=1; n < n_tasks; n++)
+		for (m=n; m > 0; m--)
+		{
+			const struct task *a = &tasks[order[m-1]];
+			const struct task *b = &tasks[order[m]];
+			if (a->worst * a->count >= b->worst * b->count)
+				break;
+			tmp = order[m-1];
+			order[m-1] = order[m];
+			order[m] = tmp;
+		}
+
+	for (n=0; n < n_tasks; n++)
+		improve_task (bases, order[n]);
+
+	for (pass = 0; pass < 100; pass++)
+	{
+		moved = 0;
+		for (n=0; n < n_tasks; n++)
+			moved |= improve_task (bases, order[n]);
+		if (!moved)
+			break;
+	}
+}
+
+
+/**
+ * Find the task that a profiled call belongs to.  Tasks that were
+ * already unrolled are profiled with a _<n> suffix on the name.
+ */
+static struct task *find_profiled_task (const char *name)
+{
+	unsigned int n;
+
+	for (n=0; n < n_tasks; n++)
+	{
+		struct task *task = &tasks[n];
+		const char *task_name = task->name + (task->name[0] == '!');
+		size_t len = strlen (task_name);
+
+		if (!strcmp (task_name, name))
+			return task;
+		if (task->already_unrolled_count && !strncmp (task_name, name, len)
+			&& name[len] == '_')
+			return task;
+	}
+	return NULL;
+}
+
+
+/**
+ * Read a measured profile.  The worst average and the worst case seen
+ * in any slot are used for the task.
+ */
+void read_profile (const char *filename)
+{
+	FILE *f;
+	char line[512];
+	char name[MAX_ID];
+	unsigned int tickno, divider, estimate, n;
+	double avg, worst;
+	struct task *task;
+
+	f = fopen (filename, "r");
+	if (!f)
+	{
+		fprintf (stderr, "error: cannot open profile '%s'\n", filename);
+		exit (1);
+	}
+
+	while (fgets (line, sizeof (line), f))
+	{
+		if (sscanf (line, "RTT %127s %u %u %u %lf %lf",
+			name, &tickno, &divider, &estimate, &avg, &worst) != 6)
+			continue;
+
+		task = find_profiled_task (name);
+		if (!task)
+		{
+			fprintf (stderr, "warning: profile has unknown task '%s'\n", name);
+			continue;
+		}
+
+		avg = avg * profile_scale / cycles_per_interrupt;
+		worst = worst * profile_scale / cycles_per_interrupt;
+		if (!task->measured_p)
+		{
+			task->len = task->worst = 0.0;
+			task->measured_p = 1;
+		}
+		if (avg > task->len)
+			task->len = avg;
+		if (worst > task->worst)
+			task->worst = worst;
+	}
+	fclose (f);
+
+	for (n=0; n < n_tasks; n++)
+		if (!tasks[n].measured_p)
+			fprintf (stderr, "warning: no profile for '%s', using the estimate\n",
+				tasks[n].name);
+}
+
+
+/**
+ * Print the load on each tick for two schedules.
+ */
+static void write_load_report (FILE *f, const int *before, const int *after)
+{
+	double avg[2][MAX_TICKS], worst[2][MAX_TICKS];
+	double peak_avg[2], peak_worst[2], mean_avg[2], mean_worst[2];
+	unsigned int n, i;
+
+	compute_loads (before, avg[0], worst[0]);
+	compute_loads (after, avg[1], worst[1]);
+
+	fprintf (f, "Load per tick, in cycles (average/worst):\n");
+	fprintf (f, "tick       before         after\n");
+	for (i=0; i < 2; i++)
+		peak_avg[i] = peak_worst[i] = mean_avg[i] = mean_worst[i] = 0.0;
+	for (n=0; n < n_ticks; n++)
+	{
+		fprintf (f, "%-6d", n);
+		for (i=0; i < 2; i++)
+		{
+			fprintf (f, "%6.0f/%-6.0f  ", avg[i][n] * cycles_per_interrupt,
+				worst[i][n] * cycles_per_interrupt);
+			if (avg[i][n] > peak_avg[i])
+				peak_avg[i] = avg[i][n];
+			if (worst[i][n] > peak_worst[i])
+				peak_worst[i] = worst[i][n];
+			mean_avg[i] += avg[i][n] / n_ticks;
+			mean_worst[i] += worst[i][n] / n_ticks;
+		}
+		fprintf (f, "\n");
+	}
+	fprintf (f, "peak  %6.0f/%-6.0f  %6.0f/%-6.0f\n",
+		peak_avg[0] * cycles_per_interrupt, peak_worst[0] * cycles_per_interrupt,
+		peak_avg[1] * cycles_per_interrupt, peak_worst[1] * cycles_per_interrupt);
+	fprintf (f, "mean  %6.0f/%-6.0f  %6.0f/%-6.0f\n",
+		mean_avg[0] * cycles_per_interrupt, mean_worst[0] * cycles_per_interrupt,
+		mean_avg[1] * cycles_per_interrupt, mean_worst[1] * cycles_per_interrupt);
+	fprintf (f, "(%d cycles per tick)\n", cycles_per_interrupt);
+}
+
+
+/**
+ * Decide which ticks each task goes into.
+ */
+void schedule_tasks (void)
+{
+	int before[MAX_TASKS], after[MAX_TASKS];
+	unsigned int n;
+
+	place_tasks_by_estimate ();
+	if (!profile_file)
+		return;
+
+	/* Remember where the estimates put everything, for the report,
+	then start over with the measured lengths. */
+	for (n=0; n < n_tasks; n++)
+		before[n] = tasks[n].base;
+	unplace_tasks ();
+
+	read_profile (profile_file);
+	optimize_bases (after);
+	for (n=0; n < n_tasks; n++)
+		place_task (&tasks[n], after[n]);
+
+	write_load_report (stderr, before, after);
+}
+
+
 /**
  * Parse a time string.  The value can be given in ticks or cycles.
  */
@@ -741,6 +1217,18 @@ int main (int argc, char *argv[])
 					prefix = argv[argn];
 					break;
 
+				case 'P':
+					profile_p = 1;
+					continue;
+
+				case 'm':
+					profile_file = argv[argn];
+					break;
+
+				case 'S':
+					profile_scale = strtod (argv[argn], NULL);
+					break;
+
 				case 'e':
 					add_cmdline_entry (argv[argn]);
 					break;
@@ -764,6 +1252,7 @@ int main (int argc, char *argv[])
 		argn++;
 	}
 
+	schedule_tasks ();
 	write_tick_driver (outfile);
 	if (outfile != stdout)
 		fclose (outfile);
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This program converts a binary signal capture, as written by the
+simulator after 'capture format binary', into the text format that it
+writes otherwise: a header line, then one line per millisecond giving
+the time and the value of each signal.  The output can be fed to
+gnuplot or any of the other tools that read text captures.
+
+Usage: sigconv [<input-file> [<output-file>]]
+Standard input/output are used when a file is not given. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <hwsim/signal.h>
+#include <hwsim/sigfile.h>
+
+FILE *in;
+FILE *out;
+
+unsigned int column_count;
+uint32_t columns[SIGFILE_MAX_COLUMNS];
+double values[SIGFILE_MAX_COLUMNS];
+
+
+void error (const char *msg)
+{
+	fprintf (stderr, "sigconv: %s\n", msg);
+	exit (1);
+}
+
+
+int read_byte (void)
+{
+	int c = getc (in);
+	if (c == EOF)
+		error ("unexpected end of file");
+	return c;
+}
+
+
+/** Read a varint.  Returns nonzero if one was read, or zero if the
+end of file was reached cleanly before it. */
+int read_varint (unsigned long *valp)
+{
+	unsigned long val = 0;
+	unsigned int shift = 0;
+	int c;
+
+	c = getc (in);
+	if (c == EOF)
+		return 0;
+	for (;;)
+	{
+		val |= (unsigned long)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			break;
+		shift += 7;
+		c = read_byte ();
+	}
+	*valp = val;
+	return 1;
+}
+
+
+unsigned long read_varint_required (void)
+{
+	unsigned long val;
+	if (!read_varint (&val))
+		error ("unexpected end of file");
+	return val;
+}
+
+
+/** Read the header at the start of a capture.  Returns zero if the
+end of file was reached instead. */
+int read_header (void)
+{
+	char magic[4];
+	unsigned int n;
+
+	if (fread (magic, sizeof (magic), 1, in) != 1)
+		return 0;
+	if (memcmp (magic, SIGFILE_MAGIC, sizeof (magic)))
+		error ("not a binary signal capture");
+	if (read_byte () != SIGFILE_VERSION)
+		error ("unsupported capture version");
+
+	column_count = read_varint_required ();
+	if (column_count > SIGFILE_MAX_COLUMNS)
+		error ("too many columns");
+
+	fprintf (out, "# Time");
+	for (n = 0; n < column_count; n++)
+	{
+		columns[n] = read_varint_required ();
+		fprintf (out, " %u", columns[n]);
+	}
+	fprintf (out, "\n");
+	return 1;
+}
+
+
+void write_line (unsigned long now)
+{
+	unsigned int n;
+	fprintf (out, "%lu", now);
+	for (n = 0; n < column_count; n++)
+		fprintf (out, " %g", values[n]);
+	fprintf (out, "\n");
+}
+
+
+void read_values (unsigned long mask)
+{
+	unsigned int n;
+
+	for (n = 0; n < column_count; n++)
+	{
+		if (!(mask & (1UL << n)))
+			continue;
+		if (columns[n] >= SIGNO_FIRST_AUTO)
+		{
+			uint32_t bits;
+			float f;
+			bits = read_byte ();
+			bits |= read_byte () << 8;
+			bits |= read_byte () << 16;
+			bits |= (uint32_t)read_byte () << 24;
+			memcpy (&f, &bits, sizeof (f));
+			values[n] = f;
+		}
+		else
+			values[n] = read_byte ();
+	}
+}
+
+
+/** Convert one capture, from its first record up to the end record. */
+void convert_capture (void)
+{
+	unsigned long delta, mask;
+	unsigned long now;
+
+	/* The first record gives the absolute start time */
+	if (!read_varint (&now))
+		return;
+	mask = read_varint_required ();
+	read_values (mask);
+
+	while (read_varint (&delta))
+	{
+		mask = read_varint_required ();
+
+		/* The previous values held until just before this record */
+		while (delta-- > 0)
+			write_line (now++);
+
+		if (mask == 0)
+			break;
+		read_values (mask);
+	}
+	write_line (now);
+}
+
+
+int main (int argc, char *argv[])
+{
+	in = stdin;
+	out = stdout;
+	if (argc > 1 && !(in = fopen (argv[1], "rb")))
+		error ("cannot open input file");
+	if (argc > 2 && !(out = fopen (argv[2], "w")))
+		error ("cannot open output file");
+
+	if (!read_header ())
+		error ("not a binary signal capture");
+
+	/* If the capture was restarted, another header follows the
+	end of the previous one. */
+	do {
+		convert_capture ();
+	} while (read_header ());
+
+	fclose (out);
+	return 0;
+}